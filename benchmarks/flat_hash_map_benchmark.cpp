@@ -0,0 +1,74 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <unordered_map>
+#include <vector>
+
+#include "utils/FlatHashMap.hpp"
+
+using namespace std;
+using namespace minicombust::utils;
+
+// Compares FlatHashMap with unordered_map on the particle solver's per timestep pattern: the map is cleared, the cells (or
+// nodes) touched this timestep are inserted, then each key is looked up several times, as the 8 node lookups per particle.
+//
+// Usage: ./bin/flat_hash_map_benchmark [KEYS_PER_STEP] [KEY_RANGE] [LOOKUPS_PER_KEY] [STEPS]
+
+template<typename Map>
+double run(Map& map, const vector<uint64_t>& keys, uint64_t keys_per_step, uint64_t lookups_per_key, uint64_t steps, uint64_t& checksum)
+{
+    const auto start = chrono::steady_clock::now();
+
+    for ( uint64_t step = 0; step < steps; step++ )
+    {
+        const uint64_t *step_keys = &keys[(step % 16) * keys_per_step];
+
+        map.clear();
+        for ( uint64_t k = 0; k < keys_per_step; k++ )
+            map[step_keys[k]] += k;
+
+        for ( uint64_t l = 0; l < lookups_per_key; l++ )
+        {
+            for ( uint64_t k = 0; k < keys_per_step; k++ )
+                checksum += map[step_keys[(k * 7919 + l) % keys_per_step]];
+        }
+
+        checksum += map.size();
+    }
+
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+int main (int argc, char ** argv)
+{
+    const uint64_t keys_per_step   = (argc > 1) ? atoll(argv[1]) : 50000;
+    const uint64_t key_range       = (argc > 2) ? atoll(argv[2]) : 10000000;
+    const uint64_t lookups_per_key = (argc > 3) ? atoll(argv[3]) : 8;
+    const uint64_t steps           = (argc > 4) ? atoll(argv[4]) : 200;
+
+    // 16 timesteps of keys, each a set of clustered cell ids like particles spread over a few regions of the mesh.
+    vector<uint64_t> keys(16 * keys_per_step);
+    srand(1);
+    for ( uint64_t i = 0; i < keys.size(); i++ )
+        keys[i] = (rand() % 64) * (key_range / 64) + rand() % (2 * keys_per_step);
+
+    uint64_t std_checksum = 0, flat_checksum = 0;
+
+    unordered_map<uint64_t, uint64_t> std_map;
+    FlatHashMap<uint64_t, uint64_t>   flat_map;
+    const double std_time  = run(std_map,  keys, keys_per_step, lookups_per_key, steps, std_checksum);
+    const double flat_time = run(flat_map, keys, keys_per_step, lookups_per_key, steps, flat_checksum);
+
+    const double operations = (double)steps * keys_per_step * (lookups_per_key + 1);
+    printf("Keys per step %lu, key range %lu, lookups per key %lu, steps %lu\n", keys_per_step, key_range, lookups_per_key, steps);
+    printf("\tunordered_map:  %8.3fs  %6.2f ns/op  (memory %8.2f MB)\n", std_time,  1.e9 * std_time  / operations, (double)(std_map.bucket_count() * sizeof(void *) + std_map.size() * (2 * sizeof(uint64_t) + sizeof(void *))) / 1.e6);
+    printf("\tFlatHashMap:    %8.3fs  %6.2f ns/op  (memory %8.2f MB)\n", flat_time, 1.e9 * flat_time / operations, (double)flat_map.get_memory_usage() / 1.e6);
+    printf("\tSpeedup:        %8.2fx\n", std_time / flat_time);
+
+    if ( std_checksum != flat_checksum )
+    {
+        printf("ERROR: checksums differ (%lu, %lu)\n", std_checksum, flat_checksum);
+        return 1;
+    }
+    return 0;
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "utils/utils.hpp"
+#include "utils/CouplingCodec.hpp"
 
 #include <Eigen/SparseCore>
 #include <Eigen/Dense>
@@ -22,6 +23,8 @@ namespace minicombust::flow
 
             double delta;
 
+            T node_cache_tolerance;
+
             vector<uint64_t *>        neighbour_indexes;
             vector<particle_aos<T> *> cell_particle_aos;
 
@@ -34,6 +37,7 @@ namespace minicombust::flow
             vector<unordered_map<uint64_t, uint64_t>>   cell_particle_field_map;
             unordered_map<uint64_t, uint64_t>           node_to_position_map;
             vector<unordered_set<uint64_t>>             local_particle_node_sets;
+            vector<unordered_map<uint64_t, flow_cache_aos<T>>> sent_node_cache;  // Per particle rank, last node values sent.
 
             uint64_t    *interp_node_indexes;
             flow_aos<T> *interp_node_flow_fields;
@@ -91,6 +95,8 @@ namespace minicombust::flow
 
             Flow_Logger logger;
 
+            CouplingCodec<T> coupling_codec;
+
         public:
             MPI_Config *mpi_config;
             PerformanceLogger<T> performance_logger;
@@ -126,7 +132,7 @@ namespace minicombust::flow
 
             const MPI_Status empty_mpi_status = { 0, 0, 0, 0, 0};
 
-            FlowSolver(MPI_Config *mpi_config, Mesh<T> *mesh, double delta) : mesh(mesh), delta(delta), mpi_config(mpi_config)
+            FlowSolver(MPI_Config *mpi_config, Mesh<T> *mesh, double delta, T node_cache_tolerance, CODEC_MODE codec_mode, T codec_tolerance) : mesh(mesh), delta(delta), node_cache_tolerance(node_cache_tolerance), coupling_codec(codec_mode, codec_tolerance), mpi_config(mpi_config)
             {
                 if (FLOW_SOLVER_DEBUG)  printf("\tRank %d: Entered FlowSolver constructor.\n", mpi_config->particle_flow_rank);
                 
@@ -159,6 +165,7 @@ namespace minicombust::flow
                 cell_particle_aos.push_back((particle_aos<T> * )malloc(cell_particle_array_size[0]));
 
                 local_particle_node_sets.push_back(unordered_set<uint64_t>());
+                sent_node_cache.resize(particle_ranks);
 
                 interp_node_indexes      = (uint64_t * )    malloc(node_index_array_size);
                 interp_node_flow_fields  = (flow_aos<T> * ) malloc(node_flow_array_size);
@@ -838,6 +845,12 @@ namespace minicombust::flow
                 }
             }
 
+            // Time spent in the particle/flow coupling exchange, including waiting on the other group.
+            double get_coupling_time ()
+            {
+                return performance_logger.update_flow_field_time;
+            }
+
             size_t get_array_memory_usage ()
             {
                 uint64_t total_node_index_array_size              = node_index_array_size;
@@ -868,7 +881,7 @@ namespace minicombust::flow
                        total_send_buffers_node_index_array_size + total_send_buffers_node_flow_array_size + total_face_field_array_size + 
                        total_phi_array_size + total_source_phi_array_size + total_phi_grad_array_size +
                        total_face_centers_array_size + total_face_normals_array_size + total_face_mass_fluxes_array_size +
-                       total_face_areas_array_size + total_face_lambdas_array_size + total_face_rlencos_array_size;
+                       total_face_areas_array_size + total_face_lambdas_array_size + total_face_rlencos_array_size + coupling_codec.get_memory_usage();
             }
 
             size_t get_stl_memory_usage ()
@@ -883,14 +896,24 @@ namespace minicombust::flow
                 uint64_t total_local_particle_node_sets_size   = 0;
                 for ( uint64_t i = 0; i < local_particle_node_sets.size(); i++ )
                     total_local_particle_node_sets_size += local_particle_node_sets[i].size() * sizeof(uint64_t);
+                uint64_t total_sent_node_cache_size            = 0;
+                for ( uint64_t i = 0; i < sent_node_cache.size(); i++ )
+                    total_sent_node_cache_size += sent_node_cache[i].size() * (sizeof(uint64_t) + sizeof(flow_cache_aos<T>));
 
 
-                return total_unordered_neighbours_set_size + total_cell_particle_field_map_size + total_node_to_position_map_size + total_mpi_requests_size + total_mpi_statuses_size + total_new_cells_size + total_local_particle_node_sets_size + total_ranks_size;
+                return total_unordered_neighbours_set_size + total_cell_particle_field_map_size + total_node_to_position_map_size + total_mpi_requests_size + total_mpi_statuses_size + total_new_cells_size + total_local_particle_node_sets_size + total_ranks_size + total_sent_node_cache_size;
             }
 
             bool is_halo( uint64_t cell );
 
             void print_logger_stats(uint64_t timesteps, double runtime);
+
+            // Hand over the cell fields, counters and timestep to the solver replacing this one when the ranks are re-split.
+            void export_cell_flow(vector<vec<T>>& centres, vector<flow_aos<T>>& flows);
+            void import_cell_flow(const uint64_t *cells, const flow_aos<T> *flows, uint64_t count);
+            Flow_Logger get_logger();
+            void add_logger(const Flow_Logger& carried);
+            void set_timestep_count(uint64_t timestep);
             
             void exchange_cell_info_halos ();
             void exchange_phi_halos ();
@@ -343,6 +343,13 @@ namespace minicombust::flow
         {
             local_particle_node_sets[i].clear();
         }
+
+        // Particle ranks drop the same nodes from their node caches at the same timesteps (ParticleSolver::evict_node_flow_cache).
+        if ( timestep_count && (timestep_count % NODE_CACHE_LIFETIME) == 0 )
+        {
+            for ( auto& rank_cache : sent_node_cache )
+                erase_if(rank_cache, [this] (const auto& cached_node) { return timestep_count - cached_node.second.version >= NODE_CACHE_LIFETIME; });
+        }
         
         performance_logger.my_papi_start();
 
@@ -372,15 +379,29 @@ namespace minicombust::flow
             {
                 uint64_t rank_slot = ranks.size();
                 ranks.push_back(statuses[rank_slot].MPI_SOURCE);
-                MPI_Get_count( &statuses[rank_slot], MPI_UINT64_T, &elements[rank_slot] );
 
-                resize_cell_particle(elements[rank_slot], rank_slot);
-                if ( FLOW_SOLVER_DEBUG )  printf("\tFlow block %d: Recieving %d indexes from %d (slot %lu). Max element size %lu. neighbour index rank size %ld array_pointer %p \n", mpi_config->particle_flow_rank, elements[rank_slot], ranks.back(), rank_slot, cell_index_array_size[rank_slot] / sizeof(uint64_t), neighbour_indexes.size(), neighbour_indexes[rank_slot]);
+                if ( coupling_codec.enabled() )
+                {
+                    // Ids and fields arrive as one encoded message, decoded once the recieve completes.
+                    int encoded_size;
+                    MPI_Get_count( &statuses[rank_slot], MPI_BYTE, &encoded_size );
+                    uint8_t *encoded_buffer = coupling_codec.get_buffer(2*rank_slot + 1, encoded_size);
+
+                    MPI_Irecv(encoded_buffer, encoded_size, MPI_BYTE, ranks[rank_slot], 0, mpi_config->world, &recv_requests[2*rank_slot] );
+                    recv_requests[2*rank_slot + 1] = MPI_REQUEST_NULL;
+                }
+                else
+                {
+                    MPI_Get_count( &statuses[rank_slot], MPI_UINT64_T, &elements[rank_slot] );
 
-                logger.recieved_cells += elements[rank_slot];
+                    resize_cell_particle(elements[rank_slot], rank_slot);
+                    if ( FLOW_SOLVER_DEBUG )  printf("\tFlow block %d: Recieving %d indexes from %d (slot %lu). Max element size %lu. neighbour index rank size %ld array_pointer %p \n", mpi_config->particle_flow_rank, elements[rank_slot], ranks.back(), rank_slot, cell_index_array_size[rank_slot] / sizeof(uint64_t), neighbour_indexes.size(), neighbour_indexes[rank_slot]);
 
-                MPI_Irecv(neighbour_indexes[rank_slot], elements[rank_slot], MPI_UINT64_T,                       ranks[rank_slot], 0, mpi_config->world, &recv_requests[2*rank_slot]     );
-                MPI_Irecv(cell_particle_aos[rank_slot], elements[rank_slot], mpi_config->MPI_PARTICLE_STRUCTURE, ranks[rank_slot], 2, mpi_config->world, &recv_requests[2*rank_slot + 1] );
+                    logger.recieved_cells += elements[rank_slot];
+
+                    MPI_Irecv(neighbour_indexes[rank_slot], elements[rank_slot], MPI_UINT64_T,                       ranks[rank_slot], 0, mpi_config->world, &recv_requests[2*rank_slot]     );
+                    MPI_Irecv(cell_particle_aos[rank_slot], elements[rank_slot], mpi_config->MPI_PARTICLE_STRUCTURE, ranks[rank_slot], 2, mpi_config->world, &recv_requests[2*rank_slot + 1] );
+                }
 
                 processed_neighbours[rank_slot] = false;
 
@@ -417,6 +438,17 @@ namespace minicombust::flow
 
                 if ( recieved_indexes && !processed_neighbours[p] )
                 {
+                    if ( coupling_codec.enabled() )
+                    {
+                        const uint8_t *encoded_buffer = coupling_codec.get_buffer(2*p + 1, 0);
+
+                        elements[p] = coupling_codec.decode_size(encoded_buffer);
+                        resize_cell_particle(elements[p], p);
+                        coupling_codec.decode(encoded_buffer, neighbour_indexes[p], cell_particle_aos[p]);
+
+                        logger.recieved_cells += elements[p];
+                    }
+
                     if ( FLOW_SOLVER_DEBUG )  printf("\tFlow block %d: Processing %d indexes from %d. Local set size %lu (%lu of %lu sets)\n", mpi_config->particle_flow_rank, elements[p], ranks[p], local_particle_node_sets[p].size(), p, local_particle_node_sets.size());
                     
                     get_neighbour_cells (p);
@@ -482,8 +514,27 @@ namespace minicombust::flow
             #pragma ivdep
             for ( uint64_t node : local_particle_node_sets[p] )
             {
+                const flow_aos<T>& node_flow = interp_node_flow_fields[node_to_position_map[node]];
+
+                // Particle ranks keep the last value they recieved for each node. Only resend if it has changed by more than the tolerance.
+                auto cached_node = sent_node_cache[ranks[p]].find(node);
+                if ( cached_node != sent_node_cache[ranks[p]].end() )
+                {
+                    cached_node->second.version = timestep_count;
+                    if ( !flow_aos_changed(cached_node->second.flow, node_flow, node_cache_tolerance) )
+                    {
+                        logger.cached_nodes++;
+                        continue;
+                    }
+                    cached_node->second.flow = node_flow;
+                }
+                else
+                {
+                    sent_node_cache[ranks[p]][node] = { node_flow, timestep_count };
+                }
+
                 send_buffers_interp_node_indexes[ptr_disp     + local_disp] = interp_node_indexes[node_to_position_map[node]];
-                send_buffers_interp_node_flow_fields[ptr_disp + local_disp] = interp_node_flow_fields[node_to_position_map[node]];
+                send_buffers_interp_node_flow_fields[ptr_disp + local_disp] = node_flow;
                 local_disp++;
                 
                 // if ( send_buffers_interp_node_indexes[ptr_disp + local_disp] > mesh->points_size )
@@ -493,8 +544,19 @@ namespace minicombust::flow
             recv_time2  -= MPI_Wtime();
             // printf("Flow Rank %3d is sending %lu data to %d\n", mpi_config->particle_flow_rank, local_disp, ranks[p]);
 
-            MPI_Isend ( send_buffers_interp_node_indexes + ptr_disp,     local_disp, MPI_UINT64_T,                   ranks[p], 0, mpi_config->world, &send_requests[p] );
-            MPI_Isend ( send_buffers_interp_node_flow_fields + ptr_disp, local_disp, mpi_config->MPI_FLOW_STRUCTURE, ranks[p], 1, mpi_config->world, &send_requests[p + ranks.size()] );
+            if ( coupling_codec.enabled() )
+            {
+                uint8_t *encoded_buffer;
+                const size_t encoded_size = coupling_codec.encode(2*p, send_buffers_interp_node_indexes + ptr_disp, send_buffers_interp_node_flow_fields + ptr_disp, local_disp, &encoded_buffer);
+
+                MPI_Isend ( encoded_buffer, encoded_size, MPI_BYTE, ranks[p], 0, mpi_config->world, &send_requests[p] );
+                send_requests[p + ranks.size()] = MPI_REQUEST_NULL;
+            }
+            else
+            {
+                MPI_Isend ( send_buffers_interp_node_indexes + ptr_disp,     local_disp, MPI_UINT64_T,                   ranks[p], 0, mpi_config->world, &send_requests[p] );
+                MPI_Isend ( send_buffers_interp_node_flow_fields + ptr_disp, local_disp, mpi_config->MPI_FLOW_STRUCTURE, ranks[p], 1, mpi_config->world, &send_requests[p + ranks.size()] );
+            }
             ptr_disp += local_disp;
 
             processed_cell_fields[p] = false;
@@ -1961,9 +2023,77 @@ namespace minicombust::flow
         if (FLOW_SOLVER_DEBUG && mpi_config->particle_flow_rank == 0) printf("\tRunning function solve_flow_equations.\n");
     }
 
-        template<class T>
+    template<class T>
+    void FlowSolver<T>::export_cell_flow(vector<vec<T>>& centres, vector<flow_aos<T>>& flows)
+    {
+        // Cells are keyed by their centres, which stay put when the blocks and cell numbering change. Temperature is not solved for.
+        centres.clear();
+        flows.clear();
+        for ( uint64_t block_cell = 0; block_cell < mesh->local_mesh_size; block_cell++ )
+        {
+            const uint64_t shmem_cell = block_cell + mesh->local_cells_disp - mesh->shmem_cell_disp;
+
+            centres.push_back(mesh->cell_centers[shmem_cell]);
+            flows.push_back({ {phi.U[block_cell], phi.V[block_cell], phi.W[block_cell]}, phi.P[block_cell], mesh->dummy_gas_tem });
+        }
+    }
+
+    template<class T>
+    void FlowSolver<T>::import_cell_flow(const uint64_t *cells, const flow_aos<T> *flows, uint64_t count)
+    {
+        // cells are global ids in this solver's mesh. Boundary values start from the initial conditions, and are rewritten from
+        // the cells in the next calculate_UVW.
+        for ( uint64_t i = 0; i < count; i++ )
+        {
+            const uint64_t block_cell = cells[i] - mesh->local_cells_disp;
+
+            phi.U[block_cell] = flows[i].vel.x;
+            phi.V[block_cell] = flows[i].vel.y;
+            phi.W[block_cell] = flows[i].vel.z;
+            phi.P[block_cell] = flows[i].pressure;
+        }
+
+        // The next timestep takes gradients before exchanging halos.
+        exchange_phi_halos();
+    }
+
+    template<class T>
+    Flow_Logger FlowSolver<T>::get_logger()
+    {
+        logger.coupling_raw_bytes     = coupling_codec.raw_bytes;
+        logger.coupling_encoded_bytes = coupling_codec.encoded_bytes;
+        logger.coupling_encode_time   = coupling_codec.encode_time;
+        logger.coupling_decode_time   = coupling_codec.decode_time;
+
+        return logger;
+    }
+
+    template<class T>
+    void FlowSolver<T>::add_logger(const Flow_Logger& carried)
+    {
+        // Counters of a replaced solver. Codec totals go to the codec, which get_logger reads them from.
+        logger.recieved_cells          += carried.recieved_cells;
+        logger.reduced_recieved_cells  += carried.reduced_recieved_cells;
+        logger.sent_nodes              += carried.sent_nodes;
+        logger.cached_nodes            += carried.cached_nodes;
+
+        coupling_codec.raw_bytes       += carried.coupling_raw_bytes;
+        coupling_codec.encoded_bytes   += carried.coupling_encoded_bytes;
+        coupling_codec.encode_time     += carried.coupling_encode_time;
+        coupling_codec.decode_time     += carried.coupling_decode_time;
+    }
+
+    template<class T>
+    void FlowSolver<T>::set_timestep_count(uint64_t timestep)
+    {
+        timestep_count = timestep;
+    }
+
+    template<class T>
     void FlowSolver<T>::print_logger_stats(uint64_t timesteps, double runtime)
     {
+        get_logger();
+
         Flow_Logger loggers[mpi_config->particle_flow_world_size];
         MPI_Gather(&logger, sizeof(Flow_Logger), MPI_BYTE, &loggers, sizeof(Flow_Logger), MPI_BYTE, 0, mpi_config->particle_flow_world);
 
@@ -1987,6 +2117,11 @@ namespace minicombust::flow
                 logger.reduced_recieved_cells += loggers[rank].reduced_recieved_cells;
                 logger.recieved_cells         += loggers[rank].recieved_cells;
                 logger.sent_nodes             += loggers[rank].sent_nodes;
+                logger.cached_nodes           += loggers[rank].cached_nodes;
+                logger.coupling_raw_bytes     += loggers[rank].coupling_raw_bytes;
+                logger.coupling_encoded_bytes += loggers[rank].coupling_encoded_bytes;
+                logger.coupling_encode_time   += loggers[rank].coupling_encode_time / mpi_config->particle_flow_world_size;
+                logger.coupling_decode_time   += loggers[rank].coupling_decode_time / mpi_config->particle_flow_world_size;
 
 
                 if ( min_cells > loggers[rank].recieved_cells )  min_cells = loggers[rank].recieved_cells ;
@@ -2006,11 +2141,19 @@ namespace minicombust::flow
             logger.reduced_recieved_cells /= non_zero_blocks;
             logger.recieved_cells /= non_zero_blocks;
             logger.sent_nodes     /= non_zero_blocks;
+            logger.cached_nodes   /= non_zero_blocks;
             
             printf("Flow Solver Stats:\t                            AVG       MIN       MAX\n");
             printf("\tReduced Recieved Cells ( per rank ) : %9.0f %9.0f %9.0f\n", round(logger.reduced_recieved_cells / timesteps), round(min_red_cells / timesteps), round(max_red_cells / timesteps));
             printf("\tRecieved Cells ( per rank )         : %9.0f %9.0f %9.0f\n", round(logger.recieved_cells / timesteps), round(min_cells / timesteps), round(max_cells / timesteps));
             printf("\tSent Nodes     ( per rank )         : %9.0f %9.0f %9.0f\n", round(logger.sent_nodes     / timesteps), round(min_nodes / timesteps), round(max_nodes / timesteps));
+            printf("\tCached Nodes   ( per rank )         : %9.0f\n", round(logger.cached_nodes / timesteps));
+            if ( coupling_codec.enabled() )
+            {
+                printf("\tCoupling Codec                      : %s\n",     codec_mode_names[coupling_codec.mode]);
+                printf("\tCoupling Compression Ratio (sent)   : %9.2f\n", logger.coupling_raw_bytes / logger.coupling_encoded_bytes);
+                printf("\tCoupling Encode/Decode Time         : %9.3fs %9.3fs\n", logger.coupling_encode_time, logger.coupling_decode_time);
+            }
             printf("\tFlow blocks with <1%% max droplets  : %d\n", mpi_config->particle_flow_world_size - (int)non_zero_blocks); 
             printf("\tAvg Cells with droplets             : %.2f%%\n", 100 * total_cells_recieved / (timesteps * mesh->mesh_size));
             printf("\tCell copies across particle ranks   : %.2f%%\n", 100.*(1 - total_reduced_cells_recieves / total_cells_recieved ));
@@ -16,6 +16,13 @@ namespace minicombust::geometry
     enum CUBE_VERTEXES    { A_VERTEX = 0, B_VERTEX = 1, C_VERTEX = 2, D_VERTEX = 3, E_VERTEX = 4, F_VERTEX = 5, G_VERTEX = 6, H_VERTEX = 7};
     enum BOUNDARY_TYPES   { NOT_BOUNDARY = 0, WALL = 1, INLET = 2, OUTLET = 3 };
 
+    // How particles find their cell.
+    //     LOCATE_WALK:       Track from the previous cell's centre across the faces the path crosses. Works for any convex hex mesh.
+    //     LOCATE_STRUCTURED: Compute the cell from the position. Axis aligned meshes with block ordered cells only (load_mesh).
+    enum CELL_LOCATOR     { LOCATE_WALK = 0, LOCATE_STRUCTURED = 1 };
+
+    inline constexpr const char *cell_locator_names[] = { "walk", "structured" };
+
 
     static const uint64_t CUBE_FACE_VERTEX_MAP[6][4] = 
     {
@@ -67,6 +74,28 @@ namespace minicombust::geometry
                 
             }
  
+            // Chooses the get_block_id lookup. Every rank sees the same block sizes, so node ranks agree on whether to allocate the window.
+            void calculate_cell_blocks(void)
+            {
+                uniform_block_cells = block_element_disp[1] - block_element_disp[0];
+                for (uint64_t b = 1; b < num_blocks; b++)
+                {
+                    if ( block_element_disp[b + 1] - block_element_disp[b] != uniform_block_cells )  uniform_block_cells = 0;
+                }
+
+                if ( uniform_block_cells || num_blocks > (uint64_t)UINT16_MAX + 1 )  return;
+
+                cell_blocks_size = shmem_mesh_size * sizeof(uint16_t);
+                MPI_Win_allocate_shared ( cell_blocks_size, sizeof(uint16_t), MPI_INFO_NULL, mpi_config->node_world, &cell_blocks, &mpi_config->win_cell_blocks );
+
+                uint64_t block = search_block_id(shmem_cell_disp);
+                for (uint64_t c = 0; c < shmem_mesh_size; c++)
+                {
+                    while ( shmem_cell_disp + c >= block_element_disp[block + 1] )  block++;
+                    cell_blocks[c] = block;
+                }
+            }
+
         public:
             const uint64_t points_size;         // Number of points in the mesh
             const uint64_t mesh_size;           // Number of polygons in the mesh
@@ -100,6 +129,19 @@ namespace minicombust::geometry
             uint64_t     *block_element_disp;
             vec<uint64_t> flow_block_dim;
 
+            // Cell to block lookup. When every block has the same number of cells the block is found by division, otherwise
+            // from the block of each cell in the node shared window, like cell_centers.
+            uint64_t      uniform_block_cells = 0;
+            uint16_t     *cell_blocks         = nullptr;
+
+
+            // Structured locator tables, per dimension: the block of each element row, and each block's first element and size.
+            CELL_LOCATOR  cell_locator = LOCATE_WALK;
+            vec<T>        element_dim;
+            vec<uint64_t> elements_per_dim;
+            uint64_t     *element_block[3]       = {nullptr, nullptr, nullptr};
+            uint64_t     *block_element_start[3] = {nullptr, nullptr, nullptr};
+            uint64_t     *block_element_size[3]  = {nullptr, nullptr, nullptr};
 
             uint64_t  boundary_cells_size;
             uint64_t *boundary_cells;
@@ -137,6 +179,9 @@ namespace minicombust::geometry
             size_t flow_term_size                  = 0;
             size_t particle_term_size              = 0;
 
+            size_t structured_locator_size         = 0;
+            size_t cell_blocks_size                = 0;
+
             Mesh(MPI_Config *mpi_config, uint64_t points_size, uint64_t mesh_size, uint64_t cell_size, uint64_t faces_size, uint64_t faces_per_cell, vec<T> *points, uint64_t *cells, Face<uint64_t> *faces, uint64_t *cell_faces, uint64_t *cell_neighbours, uint8_t *cells_per_point, uint64_t num_blocks, uint64_t *shmem_cell_disps, uint64_t *shmem_point_disps, uint64_t *block_element_disp, vec<uint64_t> flow_block_dim, uint64_t num_boundary_cells, uint64_t *boundary_cells, uint64_t num_boundary_points, vec<T> *boundary_points, uint64_t *boundary_types) 
             : mpi_config(mpi_config), points_size(points_size), mesh_size(mesh_size), cell_size(cell_size), faces_size(faces_size), faces_per_cell(faces_per_cell), points(points), cells(cells), faces(faces), cell_faces(cell_faces), cell_neighbours(cell_neighbours), cells_per_point(cells_per_point), num_blocks(num_blocks), shmem_cell_disps(shmem_cell_disps), shmem_point_disps(shmem_point_disps), block_element_disp(block_element_disp), flow_block_dim(flow_block_dim), boundary_cells_size(num_boundary_cells), boundary_cells(boundary_cells), boundary_points_size(num_boundary_points), boundary_points(boundary_points), boundary_types(boundary_types)
             {
@@ -207,6 +252,7 @@ namespace minicombust::geometry
                 MPI_Win_allocate_shared ( shmem_cell_winsize, sizeof(vec<double>), MPI_INFO_NULL, mpi_config->node_world, &cell_centers, &mpi_config->win_cell_centers );
 
                 calculate_cell_centers();
+                calculate_cell_blocks();
                 MPI_Barrier(mpi_config->world);
 
                 
@@ -292,7 +338,70 @@ namespace minicombust::geometry
                      + cells_per_point_size 
                      + 2 * block_disp_size 
                      + 2 * flow_term_size
-                     + particle_term_size;
+                     + particle_term_size
+                     + structured_locator_size
+                     + cell_blocks_size;
+            }
+
+            void set_structured_locator(vec<T> element_dim, vec<uint64_t> elements_per_dim, uint64_t **flow_block_element_sizes)
+            {
+                this->element_dim      = element_dim;
+                this->elements_per_dim = elements_per_dim;
+
+                structured_locator_size = 0;
+                for ( int i = 0; i < 3; i++ )
+                {
+                    element_block[i]       = (uint64_t *)malloc(elements_per_dim[i] * sizeof(uint64_t));
+                    block_element_start[i] = (uint64_t *)malloc(flow_block_dim[i]   * sizeof(uint64_t));
+                    block_element_size[i]  = (uint64_t *)malloc(flow_block_dim[i]   * sizeof(uint64_t));
+
+                    uint64_t start = 0;
+                    for ( uint64_t b = 0; b < flow_block_dim[i]; b++ )
+                    {
+                        block_element_start[i][b] = start;
+                        block_element_size[i][b]  = flow_block_element_sizes[i][b];
+                        for ( uint64_t e = start; e < start + flow_block_element_sizes[i][b]; e++ )
+                            element_block[i][e] = b;
+                        start += flow_block_element_sizes[i][b];
+                    }
+                    structured_locator_size += (elements_per_dim[i] + 2 * flow_block_dim[i]) * sizeof(uint64_t);
+                }
+            }
+
+            void select_cell_locator(CELL_LOCATOR locator)
+            {
+                if ( locator == LOCATE_STRUCTURED && element_block[0] == nullptr )
+                {
+                    if ( mpi_config->rank == 0 )  printf("WARNING: Mesh has no structured locator, particles will walk to their cells.\n");
+                    locator = LOCATE_WALK;
+                }
+                cell_locator = locator;
+            }
+
+            // Cell containing x, or MESH_BOUNDARY if x is outside the mesh.
+            inline uint64_t locate_structured(const vec<T>& x)
+            {
+                const T fx = x.x / element_dim.x;
+                const T fy = x.y / element_dim.y;
+                const T fz = x.z / element_dim.z;
+
+                // Negated so NaN positions are outside too.
+                if ( !(fx >= 0. && fx < (T)elements_per_dim.x && fy >= 0. && fy < (T)elements_per_dim.y && fz >= 0. && fz < (T)elements_per_dim.z) )
+                    return MESH_BOUNDARY;
+
+                const uint64_t ex = (uint64_t)fx;
+                const uint64_t ey = (uint64_t)fy;
+                const uint64_t ez = (uint64_t)fz;
+
+                const uint64_t bx = element_block[0][ex];
+                const uint64_t by = element_block[1][ey];
+                const uint64_t bz = element_block[2][ez];
+
+                const uint64_t block = bz * flow_block_dim.y * flow_block_dim.x + by * flow_block_dim.x + bx;
+
+                return block_element_disp[block] + (ez - block_element_start[2][bz]) * block_element_size[0][bx] * block_element_size[1][by]
+                                                 + (ey - block_element_start[1][by]) * block_element_size[0][bx]
+                                                 + (ex - block_element_start[0][bx]);
             }
 
             // void clear_particles_per_point_array(void)
@@ -301,6 +410,13 @@ namespace minicombust::geometry
             // }
 
             inline uint64_t get_block_id(const uint64_t cell)
+            {
+                if ( uniform_block_cells )  return cell / uniform_block_cells;
+                if ( cell_blocks )          return cell_blocks[cell - shmem_cell_disp];
+                return search_block_id(cell);
+            }
+
+            inline uint64_t search_block_id(const uint64_t cell)
             {
                 uint64_t low  = 0;
                 uint64_t high = num_blocks;
@@ -0,0 +1,272 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <math.h>
+#include <algorithm>
+
+#include "utils/FastMath.hpp"
+
+namespace minicombust::particles
+{
+    using namespace minicombust::utils;
+
+    // How the spray kernels evaluate the fuel's temperature dependent properties.
+    //     FUEL_PROPERTIES_EXACT:  The correlations, with an exp and two pows per particle.
+    //     FUEL_PROPERTIES_LINEAR: Linear interpolation in FuelPropertyTable.
+    //     FUEL_PROPERTIES_CUBIC:  Cubic interpolation in FuelPropertyTable.
+    enum FUEL_PROPERTIES { FUEL_PROPERTIES_EXACT = 0, FUEL_PROPERTIES_LINEAR = 1, FUEL_PROPERTIES_CUBIC = 2 };
+
+    inline constexpr const char *fuel_properties_names[] = { "exact", "linear table", "cubic table" };
+
+    // Properties held in the table, the ones with an exp or pow.
+    enum FUEL_TABLE_PROPERTY { TABLE_VAPOUR_PRESSURE = 0, TABLE_LATENT_HEAT = 1, TABLE_THERMAL_CONDUCTIVITY = 2, TABLE_PROPERTY_COUNT = 3 };
+
+    inline constexpr const char *fuel_table_property_names[] = { "vapour pressure", "latent heat", "thermal conductivity" };
+
+    template<class T>
+    struct fuel_properties
+    {
+        T density;
+        T vapour_pressure;
+        T latent_heat;
+        T thermal_conductivity;
+        T specific_heat;
+    };
+
+    // Fuel properties as polynomials in temperature over uniform intervals, from min_temp to the critical temperature.
+    //
+    // Only vapour pressure, latent heat and thermal conductivity are tabulated. Density and specific heat are quadratics in
+    // temperature, cheaper to evaluate than to gather from the table. Each interval stores the coefficients of all three
+    // tabulated properties together. Temperatures outside the table are clamped to its ends.
+    //
+    // The vapour pressure correlation changes constants at the boiling temperature, so the boiling temperature is an interval
+    // boundary and each interval only uses the correlation of its own side.
+    //
+    // The build samples every interval against the correlations and keeps the largest errors as the table's error bounds, both
+    // relative to the exact value and relative to the property's largest value. Latent heat falls to zero at the critical
+    // temperature with an infinite slope, so its pointwise relative error there is large whatever the interval size.
+    template<class T>
+    class FuelPropertyTable
+    {
+        public:
+            static constexpr T boiling_temp  = 333.;
+            static constexpr T critical_temp = 548.;
+
+            // The correlations used by solve_spray. FAST selects the polynomial exp/pow of FastMath.hpp for vectorised loops.
+            static inline T density(T temp)
+            {
+                return 724. * (1. - 1.8 * 0.000645 * (temp - 288.6) - 0.090 * ((temp - 288.6) * (temp - 288.6)) / 67288.36);
+            }
+
+            static inline T specific_heat(T temp, T density)
+            {
+                return (0.363 + 0.000467 * temp) * (5. - 0.001 * density);
+            }
+
+            template<bool FAST>
+            static inline __attribute__((always_inline)) T vapour_pressure(T temp, bool below_boiling)
+            {
+                const T a_constant = below_boiling ? 13.7600 : 14.1964;
+                const T b_constant = below_boiling ? 2651.13 : 2777.65;
+                return FAST ? fast_exp(a_constant - b_constant / (temp - 43.)) : exp(a_constant - b_constant / (temp - 43.));
+            }
+
+            template<bool FAST>
+            static inline __attribute__((always_inline)) fuel_properties<T> exact(T temp)
+            {
+                fuel_properties<T> properties;
+                properties.density              = density(temp);
+                properties.vapour_pressure      = vapour_pressure<FAST>(temp, temp < boiling_temp);
+                properties.latent_heat          = 346.0 * (FAST ? fast_pow((critical_temp - temp) / (critical_temp - boiling_temp), 0.38) : pow((critical_temp - temp) / (critical_temp - boiling_temp), 0.38));
+                properties.thermal_conductivity = 1.e-6*(13.2 - 0.0313 * (boiling_temp - 273.)) * (FAST ? fast_pow(temp / 273., 2. - 0.0372 * ((temp * temp) / (boiling_temp * boiling_temp))) : pow(temp / 273., 2. - 0.0372 * ((temp * temp) / (boiling_temp * boiling_temp))));
+                properties.specific_heat        = specific_heat(temp, properties.density);
+                return properties;
+            }
+
+        private:
+            static constexpr uint64_t SAMPLES_PER_INTERVAL = 64;
+
+            FUEL_PROPERTIES mode;
+            uint64_t        coefficients          = 0;  // Per property per interval, 2 for linear and 4 for cubic.
+            uint64_t        intervals             = 0;
+            T               min_temp              = 0.;
+            T               interval_temp         = 0.;
+            T               inverse_interval_temp = 0.;
+            T              *table                 = nullptr;
+
+            static inline T table_property(const fuel_properties<T>& properties, uint64_t f)
+            {
+                const T values[TABLE_PROPERTY_COUNT] = { properties.vapour_pressure, properties.latent_heat, properties.thermal_conductivity };
+                return values[f];
+            }
+
+            // Exact properties at temp, using the vapour pressure correlation of the interval's side of the boiling temperature.
+            static inline fuel_properties<T> exact_in_interval(T temp, bool below_boiling)
+            {
+                fuel_properties<T> properties = exact<false>(temp);
+                properties.vapour_pressure    = vapour_pressure<false>(temp, below_boiling);
+                return properties;
+            }
+
+        public:
+            T max_relative_error[TABLE_PROPERTY_COUNT]      = {0.};
+            T max_relative_error_temp[TABLE_PROPERTY_COUNT] = {0.};
+            T max_scaled_error[TABLE_PROPERTY_COUNT]        = {0.};  // Largest error over the largest magnitude of the property.
+
+            FuelPropertyTable(FUEL_PROPERTIES mode, T min_temp, uint64_t intervals_above_boiling) : mode(mode)
+            {
+                if ( mode == FUEL_PROPERTIES_EXACT )  return;
+
+                interval_temp                  = (critical_temp - boiling_temp) / intervals_above_boiling;
+                const uint64_t intervals_below = (uint64_t)ceil((boiling_temp - min_temp) / interval_temp);
+                intervals                      = intervals_below + intervals_above_boiling;
+                this->min_temp                 = boiling_temp - intervals_below * interval_temp;
+                inverse_interval_temp          = 1. / interval_temp;
+                coefficients                   = (mode == FUEL_PROPERTIES_CUBIC) ? 4 : 2;
+
+                table = (T *)malloc(intervals * TABLE_PROPERTY_COUNT * coefficients * sizeof(T));
+
+                T max_error[TABLE_PROPERTY_COUNT]     = {0.};
+                T max_magnitude[TABLE_PROPERTY_COUNT] = {0.};
+
+                for ( uint64_t i = 0; i < intervals; i++ )
+                {
+                    const T    low           = this->min_temp + i * interval_temp;
+                    const bool below_boiling = i < intervals_below;
+
+                    // Linear through the interval's ends. Cubic through its ends and thirds, as c0 + c1 u + c2 u^2 + c3 u^3, u in [0, 1].
+                    fuel_properties<T> samples[4];
+                    for ( uint64_t s = 0; s < coefficients; s++ )
+                        samples[s] = exact_in_interval(low + interval_temp * s / (coefficients - 1), below_boiling);
+
+                    for ( uint64_t f = 0; f < TABLE_PROPERTY_COUNT; f++ )
+                    {
+                        T *c = &table[(i * TABLE_PROPERTY_COUNT + f) * coefficients];
+                        if ( mode == FUEL_PROPERTIES_LINEAR )
+                        {
+                            c[0] = table_property(samples[0], f);
+                            c[1] = table_property(samples[1], f) - table_property(samples[0], f);
+                        }
+                        else
+                        {
+                            const T f0 = table_property(samples[0], f), f1 = table_property(samples[1], f), f2 = table_property(samples[2], f), f3 = table_property(samples[3], f);
+                            c[0] = f0;
+                            c[1] = 0.5 * (-11. * f0 + 18. * f1 -  9. * f2 + 2. * f3);
+                            c[2] = 0.5 * ( 18. * f0 - 45. * f1 + 36. * f2 - 9. * f3);
+                            c[3] = 0.5 * ( -9. * f0 + 27. * f1 - 27. * f2 + 9. * f3);
+                        }
+                    }
+
+                    // Error bounds, from points strictly inside the interval so each side of the boiling point is sampled on its own.
+                    for ( uint64_t s = 1; s < SAMPLES_PER_INTERVAL; s++ )
+                    {
+                        const T temp = low + interval_temp * s / SAMPLES_PER_INTERVAL;
+                        const fuel_properties<T> exact_properties = exact_in_interval(temp, below_boiling);
+                        const fuel_properties<T> table_properties = evaluate(temp);
+
+                        for ( uint64_t f = 0; f < TABLE_PROPERTY_COUNT; f++ )
+                        {
+                            const T exact_value = fabs(table_property(exact_properties, f));
+                            const T error       = fabs(table_property(table_properties, f) - table_property(exact_properties, f));
+                            if ( error > max_relative_error[f] * exact_value )
+                            {
+                                max_relative_error[f]      = error / exact_value;
+                                max_relative_error_temp[f] = temp;
+                            }
+                            max_error[f]     = std::max(max_error[f],     error);
+                            max_magnitude[f] = std::max(max_magnitude[f], exact_value);
+                        }
+                    }
+                }
+
+                for ( uint64_t f = 0; f < TABLE_PROPERTY_COUNT; f++ )
+                    max_scaled_error[f] = max_error[f] / max_magnitude[f];
+            }
+
+            ~FuelPropertyTable()
+            {
+                free(table);
+            }
+
+            FuelPropertyTable(const FuelPropertyTable&)            = delete;
+            FuelPropertyTable& operator=(const FuelPropertyTable&) = delete;
+
+            inline FUEL_PROPERTIES get_mode() const
+            {
+                return mode;
+            }
+
+            inline uint64_t get_intervals() const
+            {
+                return intervals;
+            }
+
+            inline T get_min_temp() const
+            {
+                return min_temp;
+            }
+
+            // A copy of the table's lookup parameters. Kernels take one before their loop, so the compiler can see that stores to
+            // particle columns don't change them, and the loop vectorises with the lookups as gathers.
+            struct lookup_view
+            {
+                const T *table;
+                T        min_temp;
+                T        inverse_interval_temp;
+                int64_t  intervals;
+
+                template<FUEL_PROPERTIES MODE>
+                inline __attribute__((always_inline)) fuel_properties<T> lookup(T temp) const
+                {
+                    static_assert(MODE != FUEL_PROPERTIES_EXACT, "lookup needs a tabulated mode");
+                    constexpr int64_t C = (MODE == FUEL_PROPERTIES_CUBIC) ? 4 : 2;
+
+                    const T       offset = (temp - min_temp) * inverse_interval_temp;
+                    const T       x      = (offset < 0.) ? 0. : (offset > (T)intervals) ? (T)intervals : offset;
+                    const int64_t last   = intervals - 1;
+                    const int64_t i      = ((int64_t)x < last) ? (int64_t)x : last;
+                    const T       u      = x - (T)i;
+
+                    // Indexed from table rather than a pointer to the interval, which GCC can't turn into gathers.
+                    const int64_t interval = i * TABLE_PROPERTY_COUNT * C;
+                    auto value = [this, interval, u] (int64_t f)
+                    {
+                        const int64_t c = interval + f * C;
+                        if constexpr ( C == 2 )  return table[c] + u * table[c + 1];
+                        else                     return table[c] + u * (table[c + 1] + u * (table[c + 2] + u * table[c + 3]));
+                    };
+
+                    fuel_properties<T> properties;
+                    properties.density              = density(temp);
+                    properties.vapour_pressure      = value(TABLE_VAPOUR_PRESSURE);
+                    properties.latent_heat          = value(TABLE_LATENT_HEAT);
+                    properties.thermal_conductivity = value(TABLE_THERMAL_CONDUCTIVITY);
+                    properties.specific_heat        = specific_heat(temp, properties.density);
+                    return properties;
+                }
+            };
+
+            inline lookup_view get_lookup_view() const
+            {
+                return { table, min_temp, inverse_interval_temp, (int64_t)intervals };
+            }
+
+            // Properties at temp in this table's mode, for scalar code.
+            inline fuel_properties<T> evaluate(T temp) const
+            {
+                switch ( mode )
+                {
+                    case FUEL_PROPERTIES_LINEAR:  return get_lookup_view().template lookup<FUEL_PROPERTIES_LINEAR>(temp);
+                    case FUEL_PROPERTIES_CUBIC:   return get_lookup_view().template lookup<FUEL_PROPERTIES_CUBIC>(temp);
+                    default:                      return exact<false>(temp);
+                }
+            }
+
+            size_t get_memory_usage() const
+            {
+                return intervals * TABLE_PROPERTY_COUNT * coefficients * sizeof(T);
+            }
+    }; // class FuelPropertyTable
+
+}   // namespace minicombust::particles
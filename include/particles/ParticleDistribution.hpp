@@ -4,7 +4,10 @@
 
 #include "geometry/Mesh.hpp"
 #include "particles/Particle.hpp"
+#include "particles/ParticleStore.hpp"
 #include "utils/utils.hpp"
+#include "utils/CounterRNG.hpp"
+#include "utils/FlatHashMap.hpp"
 
 using namespace std;
 using namespace minicombust::utils;
@@ -21,8 +24,11 @@ namespace minicombust::particles
         // private:
 
         public:
-            virtual T get_value() = 0;
-            virtual T get_scaled_value() = 0;
+            virtual T get_value(random_stream& rng) = 0;
+            virtual T get_scaled_value(random_stream& rng) = 0;
+
+            // Value for uniform draws r in [0, 1), the same draws get_value would make. Lets a batch draw its numbers in one loop.
+            virtual T from_uniform(const T& r) = 0;
 
         protected:
             Distribution() { }
@@ -46,11 +52,15 @@ namespace minicombust::particles
              { }
 
             // TODO: Add normal distribution random functionality
-            T get_value() override {
+            T get_value(random_stream&) override {
+                return mean;
+            }
+
+            T get_scaled_value(random_stream&) override {
                 return mean;
             }
 
-            T get_scaled_value() override {
+            T from_uniform(const T&) override {
                 return mean;
             }
 
@@ -77,31 +87,35 @@ namespace minicombust::particles
                 unit_mean = mean / mag;
              }
 
-            inline T get_value() override {
+            inline T get_value(random_stream& rng) override {
                 T r;
                 if constexpr(std::is_same_v<T, double>)
                 {
-                    r = static_cast<double>(rand())/RAND_MAX;
+                    r = rng.uniform();
                 }
                 else
                 {
-                    r = T { static_cast<double>(rand())/RAND_MAX, static_cast<double>(rand())/RAND_MAX, static_cast<double>(rand())/RAND_MAX } ;
+                    r = rng.uniform_vec();
                 }
 
+                return from_uniform(r);
+            }
+
+            inline T from_uniform(const T& r) override {
                 return lower + (r * (upper - lower));
             }
 
-            inline T get_scaled_value() override {
+            inline T get_scaled_value(random_stream& rng) override {
                 T r;
                 if constexpr(std::is_same_v<T, double>)
                 {
-                    r = static_cast<double>(rand())/RAND_MAX;
+                    r = rng.uniform();
                     r = lower + (r * (upper - lower));
                 }
                 else
                 {
                     // Create random unit vector on sphere surface
-                    T rnd_unit = T { static_cast<double>(rand())/RAND_MAX, static_cast<double>(rand())/RAND_MAX, static_cast<double>(rand())/RAND_MAX } ;
+                    T rnd_unit = rng.uniform_vec();
                     rnd_unit = - 1. + (rnd_unit * 2.);
 
                     T rnd_perpendicular = rnd_unit - dot_product(rnd_unit, unit_mean) * unit_mean; 
@@ -125,11 +139,15 @@ namespace minicombust::particles
              FixedDistribution(T fixed_val) : fixed_val(fixed_val)
              { }
 
-            T get_value() override {
+            T get_value(random_stream&) override {
+                return fixed_val;
+            }
+
+            T get_scaled_value(random_stream&) override {
                 return fixed_val;
             }
 
-            T get_scaled_value() override {
+            T from_uniform(const T&) override {
                 return fixed_val;
             }
 
@@ -151,6 +169,228 @@ namespace minicombust::particles
                 return cartesian_vec;
             }
 
+            // Random numbers drawn per emitted particle from the cylindrical distributions: position (0-2), velocity (3-5),
+            // acceleration (6-8) and temperature (9), in the order get_value draws them.
+            static constexpr uint64_t EMIT_DRAWS = 10;
+
+            // Largest number of injector bins along an axis.
+            static constexpr uint64_t INJECTOR_GRID_MAX_DIM = 1024;
+
+            // Injector cell set: the cells overlapping the injector annulus, binned on a uniform grid over the annulus' bounding
+            // box. An emitted position is located by testing the face planes of the few cells in its bin, instead of walking the
+            // mesh to it from the previous particle's cell.
+            vector<uint64_t>  injector_cells;
+            vector<vec<T>>    injector_face_normals;   // Outward normal of each face of each injector cell
+            vector<T>         injector_face_offsets;   // dot(normal, face centre) of each face
+            vector<uint64_t>  injector_bin_start;      // Bin b holds injector_bin_cells[injector_bin_start[b], injector_bin_start[b + 1])
+            vector<uint32_t>  injector_bin_cells;      // Indexes into injector_cells
+            vec<T>            injector_grid_low;
+            vec<T>            injector_bin_dim;
+            vec<uint64_t>     injector_grid_dim = {0, 0, 0};
+
+            // One timestep's emitted particles and their random numbers, kept between timesteps.
+            vector<T>           emit_draws;
+            vector<Particle<T>> emit_batch;
+
+            void build_injector_cells()
+            {
+                // Bounding box of the annulus. Cylindrical (r, theta, z) is cartesian (z, r cos(theta), r sin(theta)).
+                const T      inner_radius = cyclindrical_position_lower.x;
+                const T      outer_radius = cyclindrical_position_upper.x;
+                vec<T>       low          = injector_position + vec<T>{ cyclindrical_position_lower.z, -outer_radius, -outer_radius };
+                vec<T>       high         = injector_position + vec<T>{ cyclindrical_position_upper.z,  outer_radius,  outer_radius };
+
+                vector<vec<T>> cells_low;
+                vector<vec<T>> cells_high;
+                vec<T>         min_cell_dim = high - low;
+
+                // Every rank scans the whole mesh, not just its shared memory segment, so all ranks build the same set.
+                for (uint64_t cell = 0; cell < mesh->mesh_size; cell++)
+                {
+                    const uint64_t  c          = cell - mesh->shmem_cell_disp;
+                    const uint64_t *cell_nodes = &mesh->cells[c * mesh->cell_size];
+
+                    vec<T> cell_low  = mesh->points[cell_nodes[0] - mesh->shmem_point_disp];
+                    vec<T> cell_high = cell_low;
+                    for (uint64_t n = 1; n < mesh->cell_size; n++)
+                    {
+                        const vec<T>& point = mesh->points[cell_nodes[n] - mesh->shmem_point_disp];
+                        cell_low  = { min(cell_low.x,  point.x), min(cell_low.y,  point.y), min(cell_low.z,  point.z) };
+                        cell_high = { max(cell_high.x, point.x), max(cell_high.y, point.y), max(cell_high.z, point.z) };
+                    }
+
+                    if ( !(cell_low <= high && low <= cell_high) )  continue;
+
+                    // Nearest and furthest points of the cell's box from the injector axis.
+                    const T near_y = max(max(cell_low.y - injector_position.y, injector_position.y - cell_high.y), 0.);
+                    const T near_z = max(max(cell_low.z - injector_position.z, injector_position.z - cell_high.z), 0.);
+                    const T far_y  = max(abs(cell_low.y - injector_position.y), abs(cell_high.y - injector_position.y));
+                    const T far_z  = max(abs(cell_low.z - injector_position.z), abs(cell_high.z - injector_position.z));
+                    if ( near_y * near_y + near_z * near_z > outer_radius * outer_radius || far_y * far_y + far_z * far_z < inner_radius * inner_radius )  continue;
+
+                    injector_cells.push_back(cell);
+                    cells_low.push_back(cell_low);
+                    cells_high.push_back(cell_high);
+                    min_cell_dim = { min(min_cell_dim.x, cell_high.x - cell_low.x), min(min_cell_dim.y, cell_high.y - cell_low.y), min(min_cell_dim.z, cell_high.z - cell_low.z) };
+
+                    // Same face planes as Particle::track_cell.
+                    const vec<T> cell_center = mesh->cell_centers[c];
+                    for (uint64_t face = 0; face < mesh->faces_per_cell; face++)
+                    {
+                        const vec<T>& A = mesh->points[cell_nodes[CUBE_FACE_VERTEX_MAP[face][0]] - mesh->shmem_point_disp];
+                        const vec<T>& B = mesh->points[cell_nodes[CUBE_FACE_VERTEX_MAP[face][1]] - mesh->shmem_point_disp];
+                        const vec<T>& C = mesh->points[cell_nodes[CUBE_FACE_VERTEX_MAP[face][2]] - mesh->shmem_point_disp];
+                        const vec<T>& D = mesh->points[cell_nodes[CUBE_FACE_VERTEX_MAP[face][3]] - mesh->shmem_point_disp];
+
+                        const vec<T> face_center = 0.25 * (A + B + C + D);
+                        vec<T>       normal      = cross_product(D - A, C - B);
+                        if ( dot_product(normal, face_center - cell_center) < 0. )  normal = -1. * normal;
+
+                        injector_face_normals.push_back(normal);
+                        injector_face_offsets.push_back(dot_product(normal, face_center));
+                    }
+                }
+
+                // Bins are a quarter of the smallest injector cell, so most bins overlap a single cell along each axis.
+                injector_grid_low = low;
+                for (int i = 0; i < 3; i++)
+                {
+                    injector_grid_dim[i] = min(max((uint64_t)ceil(4. * (high[i] - low[i]) / min_cell_dim[i]), (uint64_t)1), INJECTOR_GRID_MAX_DIM);
+                    injector_bin_dim[i]  = (high[i] - low[i]) / injector_grid_dim[i];
+                }
+
+                // Each cell goes in every bin its box overlaps. Counted first, then filled.
+                const uint64_t bins = injector_grid_dim.x * injector_grid_dim.y * injector_grid_dim.z;
+                injector_bin_start.assign(bins + 1, 0);
+                injector_bin_cells.resize(0);
+
+                for (int pass = 0; pass < 2; pass++)
+                {
+                    if ( pass == 1 )
+                    {
+                        for (uint64_t b = 0; b < bins; b++)
+                            injector_bin_start[b + 1] += injector_bin_start[b];
+                        injector_bin_cells.resize(injector_bin_start[bins]);
+                    }
+
+                    vector<uint64_t> bin_fill(injector_bin_start.begin(), injector_bin_start.end() - 1);
+                    for (uint64_t i = 0; i < injector_cells.size(); i++)
+                    {
+                        vec<uint64_t> first, last;
+                        for (int d = 0; d < 3; d++)
+                        {
+                            first[d] = (uint64_t)min(max((cells_low[i][d]  - low[d]) / injector_bin_dim[d], 0.), (T)(injector_grid_dim[d] - 1));
+                            last[d]  = (uint64_t)min(max((cells_high[i][d] - low[d]) / injector_bin_dim[d], 0.), (T)(injector_grid_dim[d] - 1));
+                        }
+
+                        for (uint64_t z = first.z; z <= last.z; z++)
+                        for (uint64_t y = first.y; y <= last.y; y++)
+                        for (uint64_t x = first.x; x <= last.x; x++)
+                        {
+                            const uint64_t bin = (z * injector_grid_dim.y + y) * injector_grid_dim.x + x;
+                            if ( pass == 0 )  injector_bin_start[bin + 1]++;
+                            else              injector_bin_cells[bin_fill[bin]++] = i;
+                        }
+                    }
+                }
+            }
+
+            // Cell containing an emitted position x, or MESH_BOUNDARY if x is outside the mesh. Positions on a shared face, or
+            // outside the injector grid, fall back to the mesh's cell locator from a nearby cell.
+            inline uint64_t locate_injector_cell(const vec<T>& x, Particle_Logger *logger)
+            {
+                uint64_t start_cell = (injector_cells.size()) ? injector_cells[0] : mesh->mesh_size * 0.49;
+
+                const T fx = (x.x - injector_grid_low.x) / injector_bin_dim.x;
+                const T fy = (x.y - injector_grid_low.y) / injector_bin_dim.y;
+                const T fz = (x.z - injector_grid_low.z) / injector_bin_dim.z;
+                if ( fx >= 0. && fx < (T)injector_grid_dim.x && fy >= 0. && fy < (T)injector_grid_dim.y && fz >= 0. && fz < (T)injector_grid_dim.z )
+                {
+                    const uint64_t bin = ((uint64_t)fz * injector_grid_dim.y + (uint64_t)fy) * injector_grid_dim.x + (uint64_t)fx;
+                    for (uint64_t b = injector_bin_start[bin]; b < injector_bin_start[bin + 1]; b++)
+                    {
+                        if (LOGGER)  logger->cell_checks++;
+
+                        const uint64_t i      = injector_bin_cells[b];
+                        bool           inside = true;
+                        for (uint64_t face = 0; face < mesh->faces_per_cell; face++)
+                            inside &= dot_product(injector_face_normals[i * mesh->faces_per_cell + face], x) <= injector_face_offsets[i * mesh->faces_per_cell + face];
+
+                        if ( inside )  return injector_cells[i];
+                    }
+
+                    if ( injector_bin_start[bin] < injector_bin_start[bin + 1] )  start_cell = injector_cells[injector_bin_cells[injector_bin_start[bin]]];
+                }
+
+                uint64_t cell    = start_cell;
+                bool     decayed = false;
+                Particle<T>::locate_cell(mesh, x, cell, decayed, logger);
+
+                // The draw is retried rather than emitted.
+                if ( decayed )
+                {
+                    if (LOGGER)  logger->decayed_particles--;
+                    return MESH_BOUNDARY;
+                }
+                return cell;
+            }
+
+            // Whether this rank owns a block holding injector cells. Without an injector cell set particles may start anywhere.
+            bool owns_injector_cell() const
+            {
+                if ( !cylindrical || injector_cells.empty() )  return true;
+
+                for ( uint64_t cell : injector_cells )
+                {
+                    if ( (*block_owners)[mesh->get_block_id(cell)] == mpi_config->particle_flow_rank )
+                        return true;
+                }
+                return false;
+            }
+
+            // Emits batch_size particles from the injector annulus. Each random number is a pure function of the particle id and
+            // draw index, so they are drawn column by column in vectorised loops. Positions outside the mesh are redrawn,
+            // continuing the particle's stream.
+            void emit_injector_batch(uint64_t batch_size, uint64_t first_id, uint64_t timestep, Particle_Logger *logger)
+            {
+                emit_draws.resize(EMIT_DRAWS * batch_size);
+                for (uint64_t d = 0; d < EMIT_DRAWS; d++)
+                {
+                    T *draws = &emit_draws[d * batch_size];
+
+                    #pragma omp simd
+                    for (uint64_t p = 0; p < batch_size; p++)
+                        draws[p] = counter_uniform(seed, STREAM_EMIT, first_id + p, timestep, d);
+                }
+
+                const T diameter = 2 * pow(0.75 * Particle<T>::injected_mass / ( M_PI * 724.), 1./3.);
+
+                emit_batch.clear();
+                for (uint64_t p = 0; p < batch_size; p++)
+                {
+                    const T *draws = &emit_draws[p];
+                    auto draw_vec  = [&] (uint64_t d) { return vec<T>{ draws[d * batch_size], draws[(d + 1) * batch_size], draws[(d + 2) * batch_size] }; };
+
+                    vec<T> start     = injector_position + to_cartesian(cyclindrical_position->from_uniform(draw_vec(0)));
+                    vec<T> start_vel = to_cartesian(cyclindrical_velocity->from_uniform(draw_vec(3)));
+                    vec<T> start_acc = acceleration->from_uniform(draw_vec(6));
+                    T      start_tem = temperature->from_uniform(draws[9 * batch_size]);
+                    uint64_t cell    = locate_injector_cell(start, logger);
+
+                    random_stream rng = { seed, STREAM_EMIT, first_id + p, timestep, EMIT_DRAWS };
+                    while ( cell == MESH_BOUNDARY )
+                    {
+                        start     = injector_position + to_cartesian(cyclindrical_position->get_value(rng));
+                        start_vel = to_cartesian(cyclindrical_velocity->get_value(rng));
+                        start_acc = acceleration->get_value(rng);
+                        start_tem = temperature->get_value(rng);
+                        cell      = locate_injector_cell(start, logger);
+                    }
+
+                    emit_batch.push_back(Particle<T>(start, start_vel, start_acc, Particle<T>::injected_mass, start_tem, diameter, cell, first_id + p, parcel_weight));
+                }
+            }
+
         public:
             bool cylindrical = false;
 
@@ -165,6 +405,14 @@ namespace minicombust::particles
 
             vec<T> injector_position;
 
+            uint64_t seed = 0; // Key of every random stream (utils/CounterRNG.hpp)
+
+            T parcel_weight = 1.0; // Droplets each emitted particle represents
+
+            const vector<int> *block_owners = nullptr; // Owner of each block when particles are decomposed, see emit_particles_evenly.
+
+            uint64_t timestep_count = 0; // Emission calls so far, carried over when the ranks are re-split
+
 
             Distribution<vec<T>> *start_pos;
             Distribution<vec<T>> *velocity;
@@ -173,14 +421,15 @@ namespace minicombust::particles
 
             Distribution<vec<T>> *cyclindrical_position;
             Distribution<vec<T>> *cyclindrical_velocity;
+
+            vec<T> cyclindrical_position_lower; // Bounds of the injector annulus in cylindrical coordinates
+            vec<T> cyclindrical_position_upper;
             
 
             // Generate fixed distribution
             ParticleDistribution (uint64_t wave_particles_per_timestep, uint64_t even_particles_per_timestep, uint64_t remainder_particles, MPI_Config *mpi_config, Mesh<T> *mesh, vec<T> start, vec<T> vel_mean, vec<T> acc_mean, T temp, ProbabilityDistribution dist) :
                                   wave_particles_per_timestep(wave_particles_per_timestep), even_particles_per_timestep(even_particles_per_timestep), remainder_particles(remainder_particles), mpi_config(mpi_config), mesh(mesh)
             {   
-                // srand (time(NULL) + mpi_config->rank);
-                srand (0 + mpi_config->rank);
                 if (dist == UNIFORM)
                 {
                     T var = 0.2;
@@ -201,8 +450,6 @@ namespace minicombust::particles
             ParticleDistribution (uint64_t wave_particles_per_timestep, uint64_t even_particles_per_timestep, uint64_t remainder_particles, MPI_Config *mpi_config, Mesh<T> *mesh, vec<T> injector_position, double inner_injector_radius, double outer_injector_radius, vec<T> cyclindrical_velocity_mean, T temp, ProbabilityDistribution dist) :
                                   wave_particles_per_timestep(wave_particles_per_timestep), even_particles_per_timestep(even_particles_per_timestep), remainder_particles(remainder_particles), mpi_config(mpi_config), mesh(mesh), injector_position(injector_position)
             {   
-                // srand (time(NULL) + mpi_config->rank);
-                srand (0 + mpi_config->rank);
                 cylindrical = true;
 
                 if (dist == UNIFORM)
@@ -217,34 +464,50 @@ namespace minicombust::particles
                     // cyclindrical_velocity_upper.y = (mpi_config->particle_flow_rank + 1) * (2 * M_PI / (mpi_config->particle_flow_world_size + 1));
 
 
-                    vec<T> cyclindrical_position_lower = { inner_injector_radius,      0.0, -0.0001 }; 
-                    vec<T> cyclindrical_position_upper = { outer_injector_radius, 2 * M_PI, +0.0001 }; 
+                    cyclindrical_position_lower = { inner_injector_radius,      0.0, -0.0001 }; 
+                    cyclindrical_position_upper = { outer_injector_radius, 2 * M_PI, +0.0001 }; 
 
                     cyclindrical_velocity = new UniformDistribution<vec<T>>( cyclindrical_velocity_lower, cyclindrical_velocity_upper );
                     cyclindrical_position = new UniformDistribution<vec<T>>( cyclindrical_position_lower, cyclindrical_position_upper );
 
                     acceleration     = new UniformDistribution<vec<T>>(vec<T> {0.0, 0.0, 0.0}, vec<T> {0.0, 0.0, 0.0});
                     temperature      = new UniformDistribution<T>(temp - temp*0.05, temp + temp*0.05);
+
+                    build_injector_cells();
                 }
             }
 
-            inline void emit_particles_waves(vector<Particle<T>>& particles, vector<unordered_map<uint64_t, uint64_t>>& cell_particle_field_map,  uint64_t **indexes, particle_aos<T> **indexed_fields, Particle_Logger *logger)
+            // Injects mass_flow (kg/s) of fuel each timestep of length delta, spread over the particles emitted by all ranks. The
+            // particle counts become a parcel budget, each parcel representing however many droplets make up the mass flow.
+            void set_mass_flow(T mass_flow, T delta)
+            {
+                const uint64_t parcels_per_timestep = (wave_particles_per_timestep) ? wave_particles_per_timestep : even_particles_per_timestep * mpi_config->particle_flow_world_size + remainder_particles;
+                parcel_weight = mass_flow * delta / (parcels_per_timestep * Particle<T>::injected_mass);
+            }
+
+            inline void emit_particles_waves(ParticleStore<T>& particles, vector<FlatHashMap<uint64_t, uint64_t>>& cell_particle_field_map,  uint64_t **indexes, particle_aos<T> **indexed_fields, Particle_Logger *logger)
             {
                 particle_aos<T> zero_field = (particle_aos<T>){(vec<T>){0.0, 0.0, 0.0}, 0.0, 0.0};
                 uint64_t start_cell = mesh->mesh_size * 0.49;
                 
-                static int timestep_count = 0;
                 timestep_count++;
 
                 uint64_t elements [mesh->num_blocks] = {0};
 
+                random_stream rng = { seed, STREAM_EMIT, timestep_count * wave_particles_per_timestep, (uint64_t)timestep_count };
 
                 if ( (timestep_count++ % mpi_config->particle_flow_world_size) == mpi_config->particle_flow_rank )
                 {
                     for (uint64_t p = 0; p < wave_particles_per_timestep; p++)
                     {
-                        const Particle<T> particle = Particle<T>(mesh, start_pos->get_value(), velocity->get_scaled_value(), acceleration->get_value(), temperature->get_value(), start_cell, logger);
-
+                        const vec<T> start     = start_pos->get_value(rng);
+                        const vec<T> start_vel = velocity->get_scaled_value(rng);
+                        const vec<T> start_acc = acceleration->get_value(rng);
+                        const T      start_tem = temperature->get_value(rng);
+                        Particle<T> particle = Particle<T>(mesh, start, start_vel, start_acc, start_tem, start_cell, rng.id, logger);
+                        particle.weight = parcel_weight;
+
+                        // Retries keep drawing from the same particle's stream.
                         if (particle.decayed) 
                         {
                             p -= 1;
@@ -253,7 +516,8 @@ namespace minicombust::particles
                         }
 
                         start_cell = particle.cell; 
-                        particles.push_back(particle);
+                        particles.append(particle);
+                        rng = { seed, STREAM_EMIT, rng.id + 1, rng.timestep };
                         
                         const uint64_t block_id = mesh->get_block_id(particle.cell);
                         const uint64_t index    = cell_particle_field_map[block_id].size();
@@ -274,42 +538,86 @@ namespace minicombust::particles
 
                 logger->num_particles      += wave_particles_per_timestep ;
                 logger->emitted_particles  += wave_particles_per_timestep ;
+                logger->emitted_droplets   += wave_particles_per_timestep * parcel_weight;
             }
 
-            inline void emit_particles_evenly(vector<Particle<T>>& particles, vector<unordered_map<uint64_t, uint64_t>>& cell_particle_field_map, unordered_map<uint64_t, flow_aos<T> *>& node_to_field_address_map,  uint64_t **indexes, particle_aos<T> **indexed_fields, function<void(uint64_t*, uint64_t ***, particle_aos<T> ***)> resize_fn, Particle_Logger *logger)
+            // First id and number of the particles rank emits in timestep (from 1), when each of ranks emits even particles and
+            // remainder_particles more are shared out in turn. Ids follow the global emission order, so a particle draws the same
+            // numbers whatever the number of particle ranks.
+            static inline void emitted_ids(uint64_t timestep, uint64_t even, uint64_t remainder_particles, int rank, int ranks, uint64_t& first_id, uint64_t& count)
+            {
+                first_id = (timestep - 1) * (even * ranks + remainder_particles) + rank * even;
+                for (int r = 0; r < rank; r++)
+                    first_id += ((r + timestep * remainder_particles) % ranks) < remainder_particles;
+
+                count = even + (((rank + timestep * remainder_particles) % ranks) < remainder_particles);
+            }
+
+            inline void emit_particles_evenly(ParticleStore<T>& particles, vector<FlatHashMap<uint64_t, uint64_t>>& cell_particle_field_map, FlatHashMap<uint64_t, bool>& requested_nodes,  uint64_t **indexes, particle_aos<T> **indexed_fields, function<void(uint64_t*, uint64_t ***, particle_aos<T> ***)> resize_fn, Particle_Logger *logger)
             {
                 particle_aos<T> zero_field = (particle_aos<T>){(vec<T>){0.0, 0.0, 0.0}, 0.0, 0.0};
-                uint64_t start_cell = mesh->mesh_size * 0.49;
                 
-                static int timestep_count = 0;
                 timestep_count++;
-                uint64_t remainder = ((mpi_config->particle_flow_rank + timestep_count*remainder_particles) % mpi_config->particle_flow_world_size) < remainder_particles;
+                uint64_t first_id, batch_size;
+                emitted_ids(timestep_count, even_particles_per_timestep, remainder_particles, mpi_config->particle_flow_rank, mpi_config->particle_flow_world_size, first_id, batch_size);
 
+                // Decomposed particles belong to the owner of their block. Ranks owning injector cells each draw every particle of
+                // the timestep and keep their own, so emitted particles never migrate. Other ranks emit nothing.
+                if ( block_owners != nullptr )
+                {
+                    emitted_ids(timestep_count, even_particles_per_timestep * mpi_config->particle_flow_world_size + remainder_particles, 0, 0, 1, first_id, batch_size);
+                    if ( !owns_injector_cell() )  batch_size = 0;
+                }
 
-                uint64_t elements [mesh->num_blocks];
-                for (uint64_t i = 0; i < mesh->num_blocks; i++)
-                    elements[i] = 0;
+                if (cylindrical)
+                {
+                    emit_injector_batch(batch_size, first_id, timestep_count, logger);
+                }
+                else
+                {
+                    uint64_t start_cell = mesh->mesh_size * 0.49;
+                    random_stream rng = { seed, STREAM_EMIT, first_id, (uint64_t)timestep_count };
+
+                    emit_batch.clear();
+                    for (uint64_t p = 0; p < batch_size; p++)
+                    {
+                        // Draw in a fixed order, argument evaluation order is unspecified.
+                        const vec<T> start     = start_pos->get_value(rng);
+                        const vec<T> start_vel = velocity->get_scaled_value(rng);
+                        const vec<T> start_acc = acceleration->get_value(rng);
+                        const T      start_tem = temperature->get_value(rng);
+                        Particle<T> particle = Particle<T>(mesh, start, start_vel, start_acc, start_tem, start_cell, rng.id, logger);
+                        particle.weight = parcel_weight;
+
+                        // Retries keep drawing from the same particle's stream.
+                        if (particle.decayed) 
+                        {
+                            p -= 1;
+                            logger->decayed_particles--;
+                            continue;
+                        }
 
+                        start_cell = particle.cell; 
+                        emit_batch.push_back(particle);
+                        rng = { seed, STREAM_EMIT, rng.id + 1, rng.timestep };
+                    }
+                }
 
-                for (uint64_t p = 0; p < even_particles_per_timestep + remainder; p++)
+                if ( block_owners != nullptr )
                 {
-                    // printf("Rank %d trying new particle %lu\n", mpi_config->rank, p);
-                    const Particle<T> particle = (!cylindrical) ? Particle<T>(mesh, start_pos->get_value(),                                               velocity->get_scaled_value(),                     acceleration->get_value(), temperature->get_value(), start_cell, logger) :
-                                                                  Particle<T>(mesh, injector_position + to_cartesian(cyclindrical_position->get_value()), to_cartesian(cyclindrical_velocity->get_value()), acceleration->get_value(), temperature->get_value(), start_cell, logger);
-                    // printf("Rank %d trying new particle %lu decayed %d\n", mpi_config->rank, p, particle.decayed);
+                    erase_if(emit_batch, [this] (const Particle<T>& particle) { return (*block_owners)[mesh->get_block_id(particle.cell)] != mpi_config->particle_flow_rank; });
+                    batch_size = emit_batch.size();
+                }
 
-                    // cout << "Particle created at position " << print_vec(particle.x1) << " with velocity " << print_vec(particle.v1) << " with acc " << print_vec(particle.a1) << " decayed " << particle.decayed << " cell " << " temp " << particle.temp << particle.cell << endl;
+                particles.append(emit_batch.data(), batch_size);
 
-                    if (particle.decayed) 
-                    {
-                        p -= 1;
-                        logger->decayed_particles--;
-                        continue;
-                    }
 
-                    start_cell = particle.cell; 
-                    particles.push_back(particle);
+                uint64_t elements [mesh->num_blocks];
+                for (uint64_t i = 0; i < mesh->num_blocks; i++)
+                    elements[i] = 0;
 
+                for (const Particle<T>& particle : emit_batch)
+                {
                     const uint64_t block_id = mesh->get_block_id(particle.cell);
 
                     if ( !cell_particle_field_map[block_id].count(particle.cell) )
@@ -319,8 +627,6 @@ namespace minicombust::particles
 
                         resize_fn(elements, &indexes, &indexed_fields);
                         
-                        // printf("Rank %d block %lu particle is in cell %lu\n", mpi_config->rank, block_id, particle.cell);
-                        
                         indexes[block_id][index]                 = particle.cell;
                         indexed_fields[block_id][index]          = zero_field;
 
@@ -331,16 +637,28 @@ namespace minicombust::particles
                         {
                             const uint64_t node_id = mesh->cells[(particle.cell - mesh->shmem_cell_disp) * mesh->cell_size + n];
                             
-                            if (!node_to_field_address_map.count(node_id))
+                            if (!requested_nodes.count(node_id))
                             {
-                                node_to_field_address_map[node_id] = (flow_aos<T> *)1;
+                                requested_nodes[node_id] = false;
                             }
                         }
                     }
                 }
 
-                logger->num_particles      += even_particles_per_timestep + remainder;
-                logger->emitted_particles  += even_particles_per_timestep + remainder;
+                logger->num_particles      += batch_size;
+                logger->emitted_particles  += batch_size;
+                logger->emitted_droplets   += batch_size * parcel_weight;
+            }
+
+            size_t get_memory_usage() const
+            {
+                return injector_cells.capacity()        * sizeof(uint64_t)
+                     + injector_face_normals.capacity() * sizeof(vec<T>)
+                     + injector_face_offsets.capacity() * sizeof(T)
+                     + injector_bin_start.capacity()    * sizeof(uint64_t)
+                     + injector_bin_cells.capacity()    * sizeof(uint32_t)
+                     + emit_draws.capacity()            * sizeof(T)
+                     + emit_batch.capacity()            * sizeof(Particle<T>);
             }
 
 
@@ -3,9 +3,17 @@
 #include <map>
 #include <memory.h>
 #include <vector>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #include "utils/utils.hpp"
+#include "utils/CouplingCodec.hpp"
+#include "utils/FastMath.hpp"
+#include "utils/FlatHashMap.hpp"
 #include "particles/Particle.hpp"
+#include "particles/ParticleStore.hpp"
+#include "particles/FuelPropertyTable.hpp"
 #include "particles/ParticleDistribution.hpp"
 #include "performance/PerformanceLogger.hpp"
 
@@ -16,6 +24,24 @@ namespace minicombust::particles
 
     using namespace std; 
 
+    // How flow values at the cell nodes are interpolated to each particle.
+    //     INTERPOLATE_INVERSE_DISTANCE: Per component inverse square distance weights. Any cell shape.
+    //     INTERPOLATE_TRILINEAR:        Trilinear weights from the particle's position within the cell. Axis aligned hex cells only.
+    enum INTERPOLATION { INTERPOLATE_INVERSE_DISTANCE = 0, INTERPOLATE_TRILINEAR = 1 };
+
+    inline constexpr const char *interpolation_names[] = { "inverse distance", "trilinear" };
+
+    // Droplet values from one step of the spray model, used by the breakup model and to size the next sub-step.
+    template<class T>
+    struct spray_step
+    {
+        vec<T> relative_drop_vel;
+        T      relative_drop_vel_mag;
+        T      fuel_density;
+        T      fuel_vapour_pressure;
+        T      stiffness;              // Fastest relative rate of change of the droplet's velocity, mass, diameter or temperature (1/s)
+    };
+
     template<class T>
     class ParticleSolver 
     {
@@ -23,22 +49,117 @@ namespace minicombust::particles
 
             T delta;
 
+            uint64_t timestep_count = 0;
+            uint64_t recieved_nodes = 0; // Requested nodes recieved this timestep, the rest are cached.
+
             const uint64_t num_timesteps;
-            const uint64_t reserve_particles_size;
            
             vector<uint64_t>                             active_blocks;
-            vector<Particle<T>>                          particles;
-            vector<unordered_map<uint64_t, uint64_t>>    cell_particle_field_map;
-            unordered_map<uint64_t, flow_aos<T> *>       node_to_field_address_map;
+            ParticleStore<T>                             particles;
+            vector<FlatHashMap<uint64_t, uint64_t>>      cell_particle_field_map;
+            FlatHashMap<uint64_t, bool>                  requested_nodes; // Nodes requested this timestep, true once recieved. Values are read from node_flow_cache.
+            vector<FlatHashMap<uint64_t, flow_cache_aos<T>>> node_flow_cache; // Per block, last recieved value of each node.
             vector<unordered_set<uint64_t>>              neighbours_sets;
             ParticleDistribution<T>                     *particle_dist;
 
             Mesh<T> *mesh;
             
-            Particle_Logger logger;
+            Particle_Logger logger = {};
             
             PerformanceLogger<T> performance_logger;
 
+            CouplingCodec<T> coupling_codec;
+
+            // Source term aggregation. Links record which tree neighbours exchanged cells for a block, so nodes can be returned the same way.
+            struct aggregation_link
+            {
+                uint64_t              block;
+                int                   rank;   // particle_leader_world rank
+                int                   step;
+                vector<uint64_t>      cells;  // Children only, cells recieved from the child's subtree.
+                vector<uint64_t>      node_indexes;
+                vector<flow_aos<T>>   node_flow_fields;
+            };
+
+            const bool               aggregate_source_terms;
+            vector<aggregation_link> aggregation_children;
+            vector<aggregation_link> aggregation_parents;
+            vector<uint64_t>         node_member_counts;   // Node leader only, cells per (node rank, block).
+            vector<uint64_t>         node_member_cells;
+            vector<particle_aos<T>>  node_member_fields;
+            vector<uint64_t>         aggregation_indexes;
+            vector<flow_aos<T>>      aggregation_flow_fields;
+            unordered_set<uint64_t>  aggregation_node_set;
+
+            // Spatial decomposition. Each particle rank owns the regions of a contiguous range of flow blocks.
+            const bool               decompose_particles;
+            vector<int>              block_owners;
+            vector<int>              migration_neighbours;       // Ranks owning blocks next to this rank's blocks, in rank order.
+            bool                     migrate_all = false;        // Blocks changed owner, so the next migration is global.
+            Particle<T>             *migration_send_buffer      = nullptr;
+            Particle<T>             *migration_recv_buffer      = nullptr;
+            uint64_t                 migration_send_buffer_size = 0;
+            uint64_t                 migration_recv_buffer_size = 0;
+            vector<uint64_t>         migrating_particles;
+            MPI_Datatype             MPI_MIGRATION_PARTICLE;
+
+            // Load balancing. Every rebalance_frequency timesteps, ranks whose particle kernel time exceeds the mean by more than
+            // rebalance_hysteresis hand work to faster ranks (particles, or whole blocks when decomposing particles).
+            const uint64_t           rebalance_frequency;
+            const T                  rebalance_hysteresis;
+            double                   rebalance_kernel_time = 0.;
+            particle_state_aos<T>   *rebalance_send_buffer      = nullptr;
+            particle_state_aos<T>   *rebalance_recv_buffer      = nullptr;
+            uint64_t                 rebalance_send_buffer_size = 0;
+            uint64_t                 rebalance_recv_buffer_size = 0;
+            MPI_Datatype             MPI_PARTICLE_STATE;
+
+            // State each thread of the particle kernels writes instead of the solver's, merged by merge_kernel_threads once the
+            // threads finish. Chunks of particles are split between threads in order, so merging threads in order keeps breakup
+            // children in the order a single thread would make them.
+            //
+            // Batched spray kernel scratch: the vectorised pass flags breakups (1) and stiff particles to sub-cycle (SPRAY_SUBCYCLE),
+            // and keeps the breakup age and relative velocity (4 columns of breakup_scratch) for the scalar breakup post-pass.
+            static constexpr uint8_t SPRAY_SUBCYCLE       = 2;
+            struct alignas(64) kernel_thread
+            {
+                Particle_Logger                         logger;
+                vector<Particle<T>>                     breakup_children;  // Children of this timestep's breakups, appended after the spray kernel.
+                FlatHashMap<uint64_t, particle_aos<T>>  cell_fields;       // Source terms deposited in each cell.
+                uint8_t                                *breakup_mask         = nullptr;
+                T                                      *breakup_scratch      = nullptr;
+                uint64_t                                breakup_scratch_size = 0;
+            };
+
+            const uint64_t           particle_threads;
+            vector<kernel_thread>    kernel_threads;
+
+            // Cell ordering. The particle store is sorted by cell at timestep sort_frequency, then whenever sort_frequency timesteps
+            // have passed and the kernel cost lost since the last sort (growth in cost per particle over its lowest since the sort)
+            // exceeds what that sort cost. Costs are cache misses with PAPI, otherwise seconds, see PerformanceLogger::get_cost.
+            const uint64_t           sort_frequency;
+            uint64_t                 sort_timestep        = 0;
+            double                   sort_last_cost       = 0.;
+            double                   sort_baseline        = 0.;  // Lowest kernel cost per particle since the last sort.
+            double                   sort_lost_cost       = 0.;
+            double                   sort_kernel_cost     = 0.;  // Kernel cost up to the previous timestep.
+            double                   sort_step_cost       = 0.;  // Kernel cost per particle of the previous timestep.
+
+            INTERPOLATION            interpolation;
+
+            FuelPropertyTable<T>     fuel_table;
+
+            // Spray sub-cycling. Droplets that would change by more than subcycle_tolerance of their velocity, mass, diameter or
+            // temperature in one timestep (0 disables) are integrated in adaptive sub-steps instead, see integrate_spray.
+            const T                  subcycle_tolerance;
+
+            // Parcel merging. Every merge_frequency timesteps (0 disables), cells holding more than max_cell_particles particles
+            // have their parcels merged until they are back under the cap, see merge_particles.
+            const uint64_t           merge_frequency;
+            const uint64_t           max_cell_particles;
+            uint64_t                *merge_order          = nullptr;
+            uint64_t                 merge_order_size     = 0;
+
             T flow_field;
 
             T domega_Z_dt; // For mixture fraction equation
@@ -81,8 +202,8 @@ namespace minicombust::particles
 
             
             template<typename M>
-            ParticleSolver(MPI_Config *mpi_config, uint64_t ntimesteps, T delta, ParticleDistribution<T> *particle_dist, Mesh<M> *mesh, uint64_t reserve_particles_size) : 
-                           delta(delta), num_timesteps(ntimesteps), reserve_particles_size(reserve_particles_size), particle_dist(particle_dist), mesh(mesh), mpi_config(mpi_config)
+            ParticleSolver(MPI_Config *mpi_config, uint64_t ntimesteps, T delta, ParticleDistribution<T> *particle_dist, Mesh<M> *mesh, CODEC_MODE codec_mode, T codec_tolerance, bool aggregate_source_terms, bool decompose_particles, uint64_t rebalance_frequency, T rebalance_hysteresis, uint64_t sort_frequency, INTERPOLATION interpolation, FUEL_PROPERTIES fuel_properties_mode, T subcycle_tolerance, uint64_t merge_frequency, uint64_t max_cell_particles, uint64_t particle_threads) : 
+                           delta(delta), num_timesteps(ntimesteps), particle_dist(particle_dist), mesh(mesh), coupling_codec(codec_mode, codec_tolerance), aggregate_source_terms(aggregate_source_terms), decompose_particles(decompose_particles), rebalance_frequency(rebalance_frequency), rebalance_hysteresis(rebalance_hysteresis), particle_threads(particle_threads), kernel_threads(particle_threads), sort_frequency(sort_frequency), interpolation(interpolation), fuel_table(fuel_properties_mode, 200., 128), subcycle_tolerance(subcycle_tolerance), merge_frequency(merge_frequency), max_cell_particles(max_cell_particles), mpi_config(mpi_config)
             {
                 // Allocate space for the size of each block array size
                 node_index_array_sizes           = (size_t *)malloc(mesh->num_blocks * sizeof(size_t));
@@ -130,11 +251,37 @@ namespace minicombust::particles
                     cell_particle_aos[b]            = (particle_aos<T> *)malloc(cell_particle_array_sizes[b]);
 
                     neighbours_sets.push_back(unordered_set<uint64_t>());
-                    cell_particle_field_map.push_back(unordered_map<uint64_t, uint64_t>());
+                    cell_particle_field_map.push_back(FlatHashMap<uint64_t, uint64_t>());
+                    node_flow_cache.push_back(FlatHashMap<uint64_t, flow_cache_aos<T>>());
+                }
+
+                for ( uint64_t b = 0; b < mesh->num_blocks; b++ )
+                    block_owners.push_back((b * mpi_config->particle_flow_world_size) / mesh->num_blocks);
+
+                if ( decompose_particles )
+                {
+                    set_migration_neighbours();
+                    particle_dist->block_owners = &block_owners;
                 }
 
+                MPI_Type_contiguous(sizeof(Particle<T>), MPI_BYTE, &MPI_MIGRATION_PARTICLE);
+                MPI_Type_commit(&MPI_MIGRATION_PARTICLE);
+                MPI_Type_contiguous(sizeof(particle_state_aos<T>), MPI_BYTE, &MPI_PARTICLE_STATE);
+                MPI_Type_commit(&MPI_PARTICLE_STATE);
+
+                if ( decompose_particles && mpi_config->particle_flow_rank == 0 && (uint64_t)mpi_config->particle_flow_world_size > mesh->num_blocks )
+                    printf("WARNING: %d particle ranks but only %lu flow blocks, %lu particle ranks will own no region.\n", mpi_config->particle_flow_world_size, mesh->num_blocks, mpi_config->particle_flow_world_size - mesh->num_blocks);
+
+                if ( interpolation == INTERPOLATE_TRILINEAR && (mesh->cell_size != 8 || mesh->element_block[0] == nullptr) )
+                {
+                    if ( mpi_config->particle_flow_rank == 0 )  printf("WARNING: Trilinear interpolation needs an axis aligned hex mesh, using inverse distance weights.\n");
+                    this->interpolation = INTERPOLATE_INVERSE_DISTANCE;
+                }
+
+                if ( fuel_properties_mode != FUEL_PROPERTIES_EXACT && mpi_config->particle_flow_rank == 0 )
+                    printf("Fuel property %s: %lu intervals from %.1fK to %.1fK\n", fuel_properties_names[fuel_properties_mode], fuel_table.get_intervals(), fuel_table.get_min_temp(), FuelPropertyTable<T>::critical_temp);
+
                 // TODO: Play with these for performance
-                particles.reserve(reserve_particles_size);
                 // cell_particle_field_map.reserve(mesh->mesh_size / 10);
 
                 memset(&logger,           0, sizeof(Particle_Logger));
@@ -150,8 +297,8 @@ namespace minicombust::particles
                 uint64_t total_neighbours_sets_size            = 0;
                 uint64_t total_cell_particle_field_map_size    = 0;
 
-                uint64_t total_particles_size                  = particles.size() * sizeof(Particle<T>);
-                uint64_t total_node_to_field_address_map_size  = node_to_field_address_map.size() * sizeof(flow_aos<T> *);
+                uint64_t total_particles_size                  = particles.get_memory_usage();
+                uint64_t total_requested_nodes_size            = requested_nodes.get_memory_usage();
 
                 uint64_t total_memory_usage = get_array_memory_usage() + get_stl_memory_usage();
 
@@ -165,7 +312,7 @@ namespace minicombust::particles
                     total_cell_particle_array_size       += cell_particle_array_sizes[b];
 
                     total_neighbours_sets_size            += neighbours_sets[b].size() * sizeof(uint64_t);
-                    total_cell_particle_field_map_size    += cell_particle_field_map[b].size() * sizeof(uint64_t);
+                    total_cell_particle_field_map_size    += cell_particle_field_map[b].get_memory_usage();
                 }
 
                 MPI_Barrier(mpi_config->world);
@@ -181,7 +328,7 @@ namespace minicombust::particles
                     MPI_Reduce(MPI_IN_PLACE, &total_neighbours_sets_size,                         1, MPI_UINT64_T, MPI_SUM, 0, mpi_config->particle_flow_world);
                     MPI_Reduce(MPI_IN_PLACE, &total_cell_particle_field_map_size,                 1, MPI_UINT64_T, MPI_SUM, 0, mpi_config->particle_flow_world);
                     MPI_Reduce(MPI_IN_PLACE, &total_particles_size,                               1, MPI_UINT64_T, MPI_SUM, 0, mpi_config->particle_flow_world);
-                    MPI_Reduce(MPI_IN_PLACE, &total_node_to_field_address_map_size,               1, MPI_UINT64_T, MPI_SUM, 0, mpi_config->particle_flow_world);
+                    MPI_Reduce(MPI_IN_PLACE, &total_requested_nodes_size,                         1, MPI_UINT64_T, MPI_SUM, 0, mpi_config->particle_flow_world);
 
 
                     printf("Particle solver storage requirements (%d processes) : \n", mpi_config->particle_flow_world_size);
@@ -190,9 +337,9 @@ namespace minicombust::particles
                     printf("\ttotal_cell_particle_index_array_size                  (TOTAL %8.2f MB) (AVG %8.2f MB) \n"    , (float) total_cell_particle_index_array_size  / 1000000.0, (float) total_cell_particle_index_array_size / (1000000.0 * mpi_config->particle_flow_world_size));
                     printf("\ttotal_cell_particle_array_size                        (TOTAL %8.2f MB) (AVG %8.2f MB) \n"    , (float) total_cell_particle_array_size        / 1000000.0, (float) total_cell_particle_array_size       / (1000000.0 * mpi_config->particle_flow_world_size));
                     printf("\ttotal_neighbours_sets_size            (STL set)       (TOTAL %8.2f MB) (AVG %8.2f MB) \n"    , (float) total_neighbours_sets_size            / 1000000.0, (float) total_neighbours_sets_size           / (1000000.0 * mpi_config->particle_flow_world_size));
-                    printf("\ttotal_cell_particle_field_map_size    (STL map)       (TOTAL %8.2f MB) (AVG %8.2f MB) \n"    , (float) total_cell_particle_field_map_size    / 1000000.0, (float) total_cell_particle_field_map_size   / (1000000.0 * mpi_config->particle_flow_world_size));
-                    printf("\ttotal_particles_size                  (STL vector)    (TOTAL %8.2f MB) (AVG %8.2f MB) \n"    , (float) total_particles_size                  / 1000000.0, (float) total_particles_size                 / (1000000.0 * mpi_config->particle_flow_world_size));
-                    printf("\ttotal_node_to_field_address_map_size  (STL map)       (TOTAL %8.2f MB) (AVG %8.2f MB) \n\n"  , (float) total_node_to_field_address_map_size  / 1000000.0, (float) total_node_to_field_address_map_size / (1000000.0 * mpi_config->particle_flow_world_size));
+                    printf("\ttotal_cell_particle_field_map_size    (hash map)      (TOTAL %8.2f MB) (AVG %8.2f MB) \n"    , (float) total_cell_particle_field_map_size    / 1000000.0, (float) total_cell_particle_field_map_size   / (1000000.0 * mpi_config->particle_flow_world_size));
+                    printf("\ttotal_particles_size                  (chunk pool)    (TOTAL %8.2f MB) (AVG %8.2f MB) \n"    , (float) total_particles_size                  / 1000000.0, (float) total_particles_size                 / (1000000.0 * mpi_config->particle_flow_world_size));
+                    printf("\ttotal_requested_nodes_size            (hash map)      (TOTAL %8.2f MB) (AVG %8.2f MB) \n\n"  , (float) total_requested_nodes_size            / 1000000.0, (float) total_requested_nodes_size           / (1000000.0 * mpi_config->particle_flow_world_size));
 
                     printf("\tParticle solver size                                  (TOTAL %12.2f MB) (AVG %.2f MB) \n\n"  , (float)total_memory_usage                      /1000000.0,  (float)total_memory_usage / (1000000.0 * mpi_config->particle_flow_world_size));
                 }
@@ -207,7 +354,7 @@ namespace minicombust::particles
                     MPI_Reduce(&total_neighbours_sets_size,           nullptr, 1, MPI_UINT64_T, MPI_SUM, 0, mpi_config->particle_flow_world);
                     MPI_Reduce(&total_cell_particle_field_map_size,   nullptr, 1, MPI_UINT64_T, MPI_SUM, 0, mpi_config->particle_flow_world);
                     MPI_Reduce(&total_particles_size,                 nullptr, 1, MPI_UINT64_T, MPI_SUM, 0, mpi_config->particle_flow_world);
-                    MPI_Reduce(&total_node_to_field_address_map_size, nullptr, 1, MPI_UINT64_T, MPI_SUM, 0, mpi_config->particle_flow_world);
+                    MPI_Reduce(&total_requested_nodes_size,           nullptr, 1, MPI_UINT64_T, MPI_SUM, 0, mpi_config->particle_flow_world);
                 }
 
                 // for (uint64_t b = 0; b < mesh->num_blocks; b++)
@@ -291,6 +438,29 @@ namespace minicombust::particles
                 }
             }
 
+            inline kernel_thread& get_kernel_thread()
+            {
+                #ifdef _OPENMP
+                return kernel_threads[omp_get_thread_num()];
+                #else
+                return kernel_threads[0];
+                #endif
+            }
+
+            size_t get_kernel_scratch_size ()
+            {
+                size_t scratch_size = 0;
+                for (auto& thread : kernel_threads)
+                    scratch_size += thread.breakup_scratch_size * (sizeof(uint8_t) + 4 * sizeof(T));
+                return scratch_size;
+            }
+
+            // Time spent in the particle/flow coupling exchange, including waiting on the other group.
+            double get_coupling_time ()
+            {
+                return performance_logger.update_flow_field_time;
+            }
+
             size_t get_array_memory_usage ()
             {
                 uint64_t total_node_index_array_size          = 0;
@@ -315,7 +485,7 @@ namespace minicombust::particles
                 //     printf("total_cell_particle_array_size %.2f\n",       total_cell_particle_array_size        / 1.e9);
 
                 // }
-                return  total_node_index_array_size  + total_node_flow_array_size  + total_cell_particle_index_array_size + total_cell_particle_array_size ;
+                return  total_node_index_array_size  + total_node_flow_array_size  + total_cell_particle_index_array_size + total_cell_particle_array_size + coupling_codec.get_memory_usage() + (migration_send_buffer_size + migration_recv_buffer_size) * sizeof(Particle<T>) + (rebalance_send_buffer_size + rebalance_recv_buffer_size) * sizeof(particle_state_aos<T>) + get_kernel_scratch_size() + merge_order_size * sizeof(uint64_t) + fuel_table.get_memory_usage();
 
             }
 
@@ -323,40 +493,104 @@ namespace minicombust::particles
             {
                 uint64_t total_neighbours_sets_size            = 0;
                 uint64_t total_cell_particle_field_map_size    = 0;
+                uint64_t total_node_flow_cache_size            = 0;
 
-                uint64_t total_particles_size                  = particles.size() * sizeof(Particle<T>);
-                uint64_t total_node_to_field_address_map_size  = node_to_field_address_map.size() * sizeof(flow_aos<T> *);
+                uint64_t total_particles_size                  = particles.get_memory_usage();
+                uint64_t total_requested_nodes_size            = requested_nodes.get_memory_usage();
+                uint64_t total_kernel_threads_size             = 0;
+                uint64_t total_particle_dist_size              = particle_dist->get_memory_usage();
+
+                for (auto& thread : kernel_threads)
+                    total_kernel_threads_size += thread.breakup_children.capacity() * sizeof(Particle<T>) + thread.cell_fields.get_memory_usage();
 
                 for (uint64_t b = 0; b < mesh->num_blocks; b++)  
                 {
                     total_neighbours_sets_size            += neighbours_sets[b].size() * sizeof(uint64_t);
-                    total_cell_particle_field_map_size    += cell_particle_field_map[b].size() * sizeof(uint64_t);
+                    total_cell_particle_field_map_size    += cell_particle_field_map[b].get_memory_usage();
+                    total_node_flow_cache_size            += node_flow_cache[b].get_memory_usage();
                 }
 
                 // if (mpi_config->particle_flow_rank == 0)
                 // {
                 //     printf("total_particles_size %.2f\n",                 total_particles_size           / 1.e9);
-                //     printf("total_node_to_field_address_map_size %.2f\n", total_node_to_field_address_map_size          / 1.e9);
+                //     printf("total_requested_nodes_size %.2f\n", total_requested_nodes_size          / 1.e9);
                 //     printf("total_neighbours_sets_size %.2f\n",           total_neighbours_sets_size           / 1.e9);
                 //     printf("total_cell_particle_field_map_size %.2f\n",   total_cell_particle_field_map_size  / 1.e9);
 
                 // }
 
-                return total_neighbours_sets_size + total_cell_particle_field_map_size + total_particles_size + total_node_to_field_address_map_size;
+                return total_neighbours_sets_size + total_cell_particle_field_map_size + total_particles_size + total_requested_nodes_size + total_node_flow_cache_size + total_kernel_threads_size + total_particle_dist_size;
             }
 
             void output_data(uint64_t timestep);
 
             void print_logger_stats(uint64_t timesteps, double runtime);
 
+            // Hand over the particles, counters and timestep to the solver replacing this one when the ranks are re-split.
+            void export_particles(vector<Particle<T>>& exported);
+            void import_particles(const Particle<T> *imported, uint64_t count);
+            Particle_Logger get_logger();
+            void add_logger(const Particle_Logger& carried);
+            void set_timestep_count(uint64_t timestep);
+
+            void cache_node_flow(uint64_t block_id, uint64_t node, const flow_aos<T>& node_flow);
+            void evict_node_flow_cache();
+
+            void add_cell_particle_fields(uint64_t cell, const particle_aos<T>& fields);
+
+            void set_migration_neighbours();
+
+            void migrate_particles();
+
+            void rebalance_particles();
+
+            void rebalance_blocks(const double *rank_throughputs, double total_throughput);
+
+            void merge_cell_particle_fields(uint64_t block_id, const uint64_t *cells, const particle_aos<T> *fields, uint64_t size);
+
+            void aggregate_cell_particle_fields();
+
+            void distribute_aggregated_nodes();
+
             void update_flow_field(); // Synchronize point with flow solver
             
             void particle_release();
 
+            void sort_particles();
+
+            void measure_sort_benefit();
+
+            void merge_parcels(const uint64_t *group, uint64_t size);
+
+            void merge_particles();
+
+            spray_step<T> spray_substep(particle_state_aos<T>& state, const flow_aos<T>& flow, T h, particle_aos<T>& fields);
+
+            spray_step<T> integrate_spray(particle_state_aos<T>& state, const flow_aos<T>& flow, particle_aos<T>& fields, vec<T>& displacement, kernel_thread& thread);
+
+            void solve_spray(uint64_t p, kernel_thread& thread);
+
+            void solve_spray_batched(uint64_t begin, uint64_t end, kernel_thread& thread);
+
+            template<FUEL_PROPERTIES FUEL>
+            void solve_spray_batched_kernel(uint64_t begin, uint64_t end, kernel_thread& thread);
+
+            void breakup_particles(uint64_t begin, uint64_t end, kernel_thread& thread);
+
+            void append_breakup_children();
+
+            void merge_kernel_threads();
+
+            void interpolate_particles(uint64_t begin, uint64_t end);
+
+            void locate_particles(uint64_t begin, uint64_t end, kernel_thread& thread);
+
             void solve_spray_equations();
             
             void update_particle_positions();
 
+            void solve_particles_fused();
+
             void update_spray_source_terms();
 
             void map_source_terms_to_grid();
@@ -39,9 +39,106 @@ namespace minicombust::particles
         vtk_writer->write_particles("minicombust", timestep, particles);
     }
 
+    template<class T>
+    Particle_Logger ParticleSolver<T>::get_logger()
+    {
+        logger.coupling_raw_bytes     = coupling_codec.raw_bytes;
+        logger.coupling_encoded_bytes = coupling_codec.encoded_bytes;
+        logger.coupling_encode_time   = coupling_codec.encode_time;
+        logger.coupling_decode_time   = coupling_codec.decode_time;
+        logger.pool_chunks            = particles.get_resident_chunks();
+        logger.pool_peak_chunks       = particles.get_peak_chunks();
+
+        return logger;
+    }
+
+    template<class T>
+    void ParticleSolver<T>::add_logger(const Particle_Logger& carried)
+    {
+        // Counters of a replaced solver. Codec totals go to the codec, which get_logger reads them from, and the pool counters
+        // describe this solver's pool only.
+        logger.num_particles            += carried.num_particles;
+        logger.emitted_particles        += carried.emitted_particles;
+        logger.cell_checks              += carried.cell_checks;
+        logger.position_adjustments     += carried.position_adjustments;
+        logger.lost_particles           += carried.lost_particles;
+        logger.boundary_intersections   += carried.boundary_intersections;
+        logger.decayed_particles        += carried.decayed_particles;
+        logger.unsplit_particles        += carried.unsplit_particles;
+        logger.breakups                 += carried.breakups;
+        logger.burnt_particles          += carried.burnt_particles;
+        logger.avg_particles            += carried.avg_particles;
+        logger.breakup_age              += carried.breakup_age;
+        logger.interpolated_cells       += carried.interpolated_cells;
+        logger.sent_cells_per_block     += carried.sent_cells_per_block;
+        logger.sent_cells               += carried.sent_cells;
+        logger.nodes_recieved           += carried.nodes_recieved;
+        logger.useful_nodes_proportion  += carried.useful_nodes_proportion;
+        logger.cached_nodes             += carried.cached_nodes;
+        logger.evicted_nodes            += carried.evicted_nodes;
+        logger.aggregated_cells         += carried.aggregated_cells;
+        logger.migrated_particles       += carried.migrated_particles;
+        logger.global_migrations        += carried.global_migrations;
+        logger.rebalances               += carried.rebalances;
+        logger.rebalanced_particles     += carried.rebalanced_particles;
+        logger.sorts                    += carried.sorts;
+        logger.sort_cost                += carried.sort_cost;
+        logger.presort_kernel_cost      += carried.presort_kernel_cost;
+        logger.postsort_kernel_cost     += carried.postsort_kernel_cost;
+        logger.sort_saved_cost          += carried.sort_saved_cost;
+        logger.subcycled_particles      += carried.subcycled_particles;
+        logger.spray_substeps           += carried.spray_substeps;
+        logger.max_spray_substeps        = max(logger.max_spray_substeps, carried.max_spray_substeps);
+        logger.emitted_droplets         += carried.emitted_droplets;
+        logger.merged_particles         += carried.merged_particles;
+        logger.merged_cells             += carried.merged_cells;
+
+        coupling_codec.raw_bytes        += carried.coupling_raw_bytes;
+        coupling_codec.encoded_bytes    += carried.coupling_encoded_bytes;
+        coupling_codec.encode_time      += carried.coupling_encode_time;
+        coupling_codec.decode_time      += carried.coupling_decode_time;
+    }
+
+    template<class T>
+    void ParticleSolver<T>::set_timestep_count(uint64_t timestep)
+    {
+        // Every timestep emits once, so the emission count follows the timestep.
+        timestep_count                = timestep;
+        particle_dist->timestep_count = timestep;
+    }
+
+    template<class T>
+    void ParticleSolver<T>::export_particles(vector<Particle<T>>& exported)
+    {
+        exported.clear();
+        exported.reserve(particles.size());
+        for ( uint64_t p = 0; p < particles.size(); p++ )
+            exported.push_back(particles.get(p));
+    }
+
+    template<class T>
+    void ParticleSolver<T>::import_particles(const Particle<T> *imported, uint64_t count)
+    {
+        // Imported particles arrive like migrated ones, with their cells in this solver's mesh. Decomposed particles then take
+        // the global migration path to the owners of their blocks.
+        for ( uint64_t i = 0; i < count; i++ )
+        {
+            particles.append(imported[i]);
+            add_cell_particle_fields(imported[i].cell, imported[i].particle_cell_fields);
+        }
+
+        if ( decompose_particles )
+        {
+            migrate_all = true;
+            migrate_particles();
+        }
+    }
+
     template<class T>
     void ParticleSolver<T>::print_logger_stats(uint64_t timesteps, double runtime)
     {
+        get_logger();
+
         Particle_Logger loggers[mpi_config->particle_flow_world_size];
         MPI_Gather(&logger, sizeof(Particle_Logger), MPI_BYTE, &loggers, sizeof(Particle_Logger), MPI_BYTE, 0, mpi_config->particle_flow_world);
         
@@ -62,6 +159,30 @@ namespace minicombust::particles
             logger.sent_cells_per_block     += loggers[rank].sent_cells_per_block    / (double)  mpi_config->particle_flow_world_size;
             logger.nodes_recieved           += loggers[rank].nodes_recieved          / (double)  mpi_config->particle_flow_world_size;
             logger.useful_nodes_proportion  += loggers[rank].useful_nodes_proportion / (double)  mpi_config->particle_flow_world_size;
+            logger.cached_nodes             += loggers[rank].cached_nodes            / (double)  mpi_config->particle_flow_world_size;
+            logger.evicted_nodes            += loggers[rank].evicted_nodes           / (double)  mpi_config->particle_flow_world_size;
+            logger.coupling_raw_bytes       += loggers[rank].coupling_raw_bytes;
+            logger.coupling_encoded_bytes   += loggers[rank].coupling_encoded_bytes;
+            logger.coupling_encode_time     += loggers[rank].coupling_encode_time    / (double)  mpi_config->particle_flow_world_size;
+            logger.coupling_decode_time     += loggers[rank].coupling_decode_time    / (double)  mpi_config->particle_flow_world_size;
+            logger.aggregated_cells         += loggers[rank].aggregated_cells        / (double)  mpi_config->particle_flow_world_size;
+            logger.migrated_particles       += loggers[rank].migrated_particles;
+            logger.global_migrations        += loggers[rank].global_migrations        / (double)  mpi_config->particle_flow_world_size;
+            logger.rebalances               += loggers[rank].rebalances               / (double)  mpi_config->particle_flow_world_size;
+            logger.rebalanced_particles     += loggers[rank].rebalanced_particles;
+            logger.sorts                    += loggers[rank].sorts                    / (double)  mpi_config->particle_flow_world_size;
+            logger.sort_cost                += loggers[rank].sort_cost                / (double)  mpi_config->particle_flow_world_size;
+            logger.presort_kernel_cost      += loggers[rank].presort_kernel_cost      / (double)  mpi_config->particle_flow_world_size;
+            logger.postsort_kernel_cost     += loggers[rank].postsort_kernel_cost     / (double)  mpi_config->particle_flow_world_size;
+            logger.sort_saved_cost          += loggers[rank].sort_saved_cost          / (double)  mpi_config->particle_flow_world_size;
+            logger.subcycled_particles      += loggers[rank].subcycled_particles;
+            logger.spray_substeps           += loggers[rank].spray_substeps;
+            logger.max_spray_substeps        = max(logger.max_spray_substeps, loggers[rank].max_spray_substeps);
+            logger.emitted_droplets         += loggers[rank].emitted_droplets;
+            logger.merged_particles         += loggers[rank].merged_particles;
+            logger.merged_cells             += loggers[rank].merged_cells;
+            logger.pool_chunks              += loggers[rank].pool_chunks              / (double)  mpi_config->particle_flow_world_size;
+            logger.pool_peak_chunks          = max(logger.pool_peak_chunks, loggers[rank].pool_peak_chunks);
         }
 
         MPI_Barrier(mpi_config->world);
@@ -73,7 +194,20 @@ namespace minicombust::particles
             cout << "\tParticles (per iter):                        " << particle_dist->even_particles_per_timestep*mpi_config->particle_flow_world_size                  << endl;
             cout << "\tEmitted Particles:                           " << logger.emitted_particles                                                                         << endl;
             cout << "\tAvg Particles (per iter):                    " << logger.avg_particles                                                                             << endl;
+            if ( particle_dist->parcel_weight != 1. )
+            {
+                cout << "\tEmitted Droplets:                            " << logger.emitted_droplets                                                                          << endl;
+                cout << "\tDroplets per Parcel:                         " << particle_dist->parcel_weight                                                                     << endl;
+            }
             cout << endl;
+            cout << "\tCell Locator:                                " << cell_locator_names[mesh->cell_locator]                                                          << endl;
+            cout << "\tInterpolation:                               " << interpolation_names[interpolation]                                                              << endl;
+            cout << "\tFuel Properties:                             " << fuel_properties_names[fuel_table.get_mode()]                                                    << endl;
+            if ( fuel_table.get_mode() != FUEL_PROPERTIES_EXACT )
+            {
+                for ( uint64_t f = 0; f < TABLE_PROPERTY_COUNT; f++ )
+                    printf("\t\tMax error %-21s %.3e of value (at %.2fK), %.3e of largest value\n", fuel_table_property_names[f], fuel_table.max_relative_error[f], fuel_table.max_relative_error_temp[f], fuel_table.max_scaled_error[f]);
+            }
             cout << "\tCell checks:                                 " << ((double)logger.cell_checks)                                                                     << endl;
             cout << "\tCell checks (per iter):                      " << ((double)logger.cell_checks) / timesteps                                                         << endl;
             cout << "\tCell checks (per particle, per iter):        " << ((double)logger.cell_checks) / (((double)logger.num_particles)*timesteps)                        << endl;
@@ -89,283 +223,1969 @@ namespace minicombust::particles
             cout << "\tBurnt Particles:                             " << ((double)logger.burnt_particles)                                                                 << endl;
             cout << "\tBreakups:                                    " << ((double)logger.breakups)                                                                        << endl;
             cout << "\tBreakup Age:                                 " << ((double)logger.breakup_age)                                                                     << endl;
+            if ( subcycle_tolerance > 0. )
+            {
+                cout << "\tSub-cycled Particles (per iter):             " << logger.subcycled_particles / timesteps                                                          << endl;
+                cout << "\tSpray Sub-steps (per sub-cycled particle):   " << ((logger.subcycled_particles > 0.) ? logger.spray_substeps / logger.subcycled_particles : 0.)  << endl;
+                cout << "\tMax Spray Sub-steps:                         " << logger.max_spray_substeps                                                                        << endl;
+            }
+            cout << "\tParticle Pool Chunk:                         " << PARTICLE_POOL_CHUNK << " particles, " << particles.get_chunk_size() / 1.e6 << " MB"               << endl;
+            cout << "\tParticle Pool Chunks (avg per rank):         " << logger.pool_chunks                                                                               << endl;
+            cout << "\tParticle Pool Peak Chunks (max rank):        " << logger.pool_peak_chunks                                                                          << endl;
+            if ( merge_frequency )
+            {
+                cout << "\tMerged Particles:                            " << logger.merged_particles                                                                          << endl;
+                cout << "\tMax Particles per Cell:                      " << max_cell_particles                                                                               << endl;
+                cout << "\tCrowded Cells (per merge):                   " << logger.merged_cells / ((double)timesteps / merge_frequency)                                     << endl;
+            }
             cout << endl; 
             cout << "\tAvg Sent Cells       (avg per rank, block):  " << round(logger.sent_cells_per_block / timesteps)                                                   << endl;
             cout << "\tTotal Sent Cells     (avg per rank):         " << round(logger.sent_cells / timesteps)                                                             << endl;
             cout << "\tTotal Recieved Nodes (avg per rank):         " << round(logger.nodes_recieved / timesteps)                                                         << endl;
             cout << "\tUseful Nodes         (avg per rank):         " << round(logger.useful_nodes_proportion / timesteps)                                                << endl;
             cout << "\tUseful Nodes (%)     (avg per rank):         " << round(10000.*((logger.useful_nodes_proportion) / (logger.nodes_recieved))) / 100. << "% "        << endl;
+            cout << "\tCached Nodes         (avg per rank):         " << round(logger.cached_nodes / timesteps)                                                           << endl;
+            cout << "\tEvicted Nodes        (avg per rank, total):  " << round(logger.evicted_nodes)                                                                      << endl;
+            if ( aggregate_source_terms )
+                cout << "\tAggregated Cell Copies (avg per rank):       " << round(logger.aggregated_cells / timesteps)                                                       << endl;
+            if ( decompose_particles )
+            {
+                cout << "\tMigrated Particles   (per iter):             " << round(logger.migrated_particles / timesteps)                                                     << endl;
+                cout << "\tGlobal Migrations:                           " << logger.global_migrations                                                                         << endl;
+            }
+            if ( rebalance_frequency )
+            {
+                cout << "\tLoad Rebalances:                             " << logger.rebalances                                                                                << endl;
+                cout << "\tRebalanced Particles:                        " << logger.rebalanced_particles                                                                      << endl;
+            }
+            if ( sort_frequency )
+            {
+                const string unit = performance_logger.get_cost_unit();
+                cout << endl;
+                cout << "\tCell Sorts           (avg per rank):         " << logger.sorts                                                                                     << endl;
+                cout << "\tAvg Sort Interval    (timesteps):            " << ((logger.sorts > 0.) ? timesteps / logger.sorts : 0.)                                            << endl;
+                cout << "\tSort Cost            (avg per rank):         " << logger.sort_cost << " " << unit                                                                 << endl;
+                cout << "\tKernel Cost Saved After Sorts:               " << logger.sort_saved_cost << " " << unit                                                           << endl;
+                cout << "\tKernel Speedup After Sort:                   " << logger.presort_kernel_cost / logger.postsort_kernel_cost                                         << endl;
+            }
+            if ( coupling_codec.enabled() )
+            {
+                cout << endl;
+                cout << "\tCoupling Codec:                              " << codec_mode_names[coupling_codec.mode]                                                            << endl;
+                cout << "\tCoupling Compression Ratio (sent):           " << logger.coupling_raw_bytes / logger.coupling_encoded_bytes                                       << endl;
+                cout << "\tCoupling Encode Time (avg per rank):         " << logger.coupling_encode_time << "s"                                                              << endl;
+                cout << "\tCoupling Decode Time (avg per rank):         " << logger.coupling_decode_time << "s"                                                              << endl;
+            }
+
+            cout << endl;
+
+            cout <<"NOTE: REDUCING RELATIVE GAS VEL by 50\% in Particle.hpp while flow isn't implemented!!!" << endl;
+            cout << endl;
+        }
+
+        performance_logger.print_counters(mpi_config->rank, mpi_config->world_size, runtime);
+    }
+
+
+    template<class T>
+    void ParticleSolver<T>::cache_node_flow(uint64_t block_id, uint64_t node, const flow_aos<T>& node_flow)
+    {
+        flow_cache_aos<T>& cached_node = node_flow_cache[block_id][node];
+        cached_node.flow    = node_flow;
+        cached_node.version = timestep_count;
+
+        // Count each requested node once, the first time it is recieved in a timestep.
+        bool& recieved  = requested_nodes[node];
+        recieved_nodes += !recieved;
+        recieved        = true;
+    }
+
+    template<class T>
+    void ParticleSolver<T>::evict_node_flow_cache()
+    {
+        // Flow ranks only resend nodes which changed, so both sides must drop a node together. Each side stamps a node with the
+        // timestep it was last requested, and both drop nodes older than NODE_CACHE_LIFETIME at the same timesteps, before the
+        // requests are made.
+        if ( timestep_count == 0 || (timestep_count % NODE_CACHE_LIFETIME) != 0 )  return;
+
+        vector<uint64_t> evicted_nodes;
+        for (uint64_t b = 0; b < mesh->num_blocks; b++)
+        {
+            evicted_nodes.clear();
+            for ( auto& cached_node : node_flow_cache[b] )
+            {
+                if ( timestep_count - cached_node.second.version >= NODE_CACHE_LIFETIME )
+                    evicted_nodes.push_back(cached_node.first);
+            }
+
+            for ( uint64_t node : evicted_nodes )
+                node_flow_cache[b].erase(node);
+
+            logger.evicted_nodes += evicted_nodes.size();
+        }
+    }
+
+    template<class T>
+    void ParticleSolver<T>::add_cell_particle_fields(uint64_t cell, const particle_aos<T>& fields)
+    {
+        const uint64_t block_id = mesh->get_block_id(cell);
+
+        if ( const uint64_t *cell_index = cell_particle_field_map[block_id].find(cell) ) 
+        {
+            const uint64_t index = *cell_index;
+
+            cell_particle_aos[block_id][index].momentum += fields.momentum;
+            cell_particle_aos[block_id][index].energy   += fields.energy;
+            cell_particle_aos[block_id][index].fuel     += fields.fuel;
+        }
+        else
+        {
+            uint64_t elements [mesh->num_blocks];
+            for (uint64_t b = 0; b < mesh->num_blocks; b++)
+                elements[b] = 0;
+
+            const uint64_t index = cell_particle_field_map[block_id].size();
+            elements[block_id]   = cell_particle_field_map[block_id].size() + 1;
+
+            resize_cell_particle(elements, NULL, NULL);
+
+            cell_particle_indexes[block_id][index]   = cell;
+            cell_particle_aos[block_id][index]       = fields;
+
+            cell_particle_field_map[block_id][cell]  = index;
+
+            #pragma ivdep
+            for (uint64_t n = 0; n < mesh->cell_size; n++)
+            {
+                const uint64_t node_id = mesh->cells[(cell - mesh->shmem_cell_disp) * mesh->cell_size + n];
+
+                if (!requested_nodes.count(node_id))
+                {
+                    requested_nodes[node_id] = false;
+                }
+            }
+        }
+    }
+
+    template<class T>
+    void ParticleSolver<T>::set_migration_neighbours()
+    {
+        // Blocks form a flow_block_dim grid (load_mesh). A rank's neighbours own any of the 26 blocks around one of its blocks,
+        // so the relation is symmetric. Other block layouts make every rank a neighbour.
+        const int      ranks = mpi_config->particle_flow_world_size;
+        const uint64_t dim_x = mesh->flow_block_dim.x, dim_y = mesh->flow_block_dim.y, dim_z = mesh->flow_block_dim.z;
+
+        const bool grid = (dim_x * dim_y * dim_z == mesh->num_blocks);
+
+        bool neighbour[ranks];
+        for ( int r = 0; r < ranks; r++ )
+            neighbour[r] = !grid;
+
+        for ( uint64_t b = 0; b < mesh->num_blocks && grid; b++ )
+        {
+            if ( block_owners[b] != mpi_config->particle_flow_rank )  continue;
+
+            const int64_t bx = b % dim_x, by = (b / dim_x) % dim_y, bz = b / (dim_x * dim_y);
+            for ( int64_t z = max(bz - 1, (int64_t)0); z <= min(bz + 1, (int64_t)dim_z - 1); z++ )
+                for ( int64_t y = max(by - 1, (int64_t)0); y <= min(by + 1, (int64_t)dim_y - 1); y++ )
+                    for ( int64_t x = max(bx - 1, (int64_t)0); x <= min(bx + 1, (int64_t)dim_x - 1); x++ )
+                        neighbour[block_owners[z * dim_y * dim_x + y * dim_x + x]] = true;
+        }
+
+        migration_neighbours.clear();
+        for ( int r = 0; r < ranks; r++ )
+        {
+            if ( neighbour[r] && r != mpi_config->particle_flow_rank )
+                migration_neighbours.push_back(r);
+        }
+    }
+
+    template<class T>
+    void ParticleSolver<T>::migrate_particles()
+    {
+        // Send particles outside this rank's region to the rank owning their block. Particles are emitted on the rank owning their
+        // block, and only move to the next block in a timestep, so ranks only exchange with their migration neighbours. After a
+        // rebalance, or if a particle skipped past the neighbouring blocks, the ranks agree to exchange with every rank instead.
+        // Arriving particles add their source terms from the last position update here.
+        performance_logger.my_papi_start();
+
+        if (PARTICLE_SOLVER_DEBUG && mpi_config->rank == mpi_config->particle_flow_rank )  printf("\tRank %d: Running fn: migrate_particles.\n", mpi_config->rank);
+
+        const int ranks = mpi_config->particle_flow_world_size;
+
+        int send_counts[ranks], recv_counts[ranks], send_displs[ranks], recv_displs[ranks];
+        for ( int r = 0; r < ranks; r++ )
+            send_counts[r] = 0;
+
+        migrating_particles.clear();
+        for ( uint64_t p = 0; p < particles.size(); p++ )
+        {
+            const int owner = block_owners[mesh->get_block_id(particles.cell[p])];
+            if ( owner != mpi_config->particle_flow_rank )
+            {
+                migrating_particles.push_back(p);
+                send_counts[owner]++;
+            }
+        }
+
+        int neighbour_sends = 0;
+        for ( int r : migration_neighbours )
+            neighbour_sends += send_counts[r];
+
+        int global_migration = migrate_all || (neighbour_sends != (int)migrating_particles.size());
+        MPI_Allreduce(MPI_IN_PLACE, &global_migration, 1, MPI_INT, MPI_LOR, mpi_config->particle_flow_world);
+        migrate_all = false;
+
+        send_displs[0] = 0;
+        for ( int r = 1; r < ranks; r++ )
+            send_displs[r] = send_displs[r - 1] + send_counts[r - 1];
+
+        int offsets[ranks];
+        for ( int r = 0; r < ranks; r++ )
+            offsets[r] = send_displs[r];
+
+        if ( migration_send_buffer_size < migrating_particles.size() )
+        {
+            migration_send_buffer_size = 2 * migrating_particles.size();
+            migration_send_buffer      = (Particle<T> *)realloc(migration_send_buffer, migration_send_buffer_size * sizeof(Particle<T>));
+        }
+        for ( uint64_t i = 0; i < migrating_particles.size(); i++ )
+        {
+            const uint64_t p = migrating_particles[i];
+            migration_send_buffer[offsets[block_owners[mesh->get_block_id(particles.cell[p])]]++] = particles.get(p);
+        }
+
+        // Sent particles are flagged and compacted away with the decayed ones, keeping the others in order.
+        for ( uint64_t i = 0; i < migrating_particles.size(); i++ )
+            particles.decayed[migrating_particles[i]] = true;
+        particles.remove_decayed();
+
+        const int neighbours = migration_neighbours.size();
+        vector<MPI_Request> requests(2 * neighbours);
+
+        if ( global_migration )
+        {
+            MPI_Alltoall(send_counts, 1, MPI_INT, recv_counts, 1, MPI_INT, mpi_config->particle_flow_world);
+        }
+        else
+        {
+            for ( int r = 0; r < ranks; r++ )
+                recv_counts[r] = 0;
+            for ( int n = 0; n < neighbours; n++ )
+            {
+                MPI_Irecv(&recv_counts[migration_neighbours[n]], 1, MPI_INT, migration_neighbours[n], 0, mpi_config->particle_flow_world, &requests[n]);
+                MPI_Isend(&send_counts[migration_neighbours[n]], 1, MPI_INT, migration_neighbours[n], 0, mpi_config->particle_flow_world, &requests[neighbours + n]);
+            }
+            MPI_Waitall(requests.size(), requests.data(), MPI_STATUSES_IGNORE);
+        }
+
+        recv_displs[0] = 0;
+        for ( int r = 1; r < ranks; r++ )
+            recv_displs[r] = recv_displs[r - 1] + recv_counts[r - 1];
+        const uint64_t recv_size = recv_displs[ranks - 1] + recv_counts[ranks - 1];
+
+        if ( migration_recv_buffer_size < recv_size )
+        {
+            migration_recv_buffer_size = 2 * recv_size;
+            migration_recv_buffer      = (Particle<T> *)realloc(migration_recv_buffer, migration_recv_buffer_size * sizeof(Particle<T>));
+        }
+
+        // Particles arrive in rank order either way.
+        if ( global_migration )
+        {
+            MPI_Alltoallv(migration_send_buffer, send_counts, send_displs, MPI_MIGRATION_PARTICLE, 
+                          migration_recv_buffer, recv_counts, recv_displs, MPI_MIGRATION_PARTICLE, mpi_config->particle_flow_world);
+        }
+        else
+        {
+            // Both sides know the counts, so empty messages are skipped.
+            for ( int n = 0; n < neighbours; n++ )
+            {
+                const int r = migration_neighbours[n];
+                requests[n] = requests[neighbours + n] = MPI_REQUEST_NULL;
+                if ( recv_counts[r] )  MPI_Irecv(migration_recv_buffer + recv_displs[r], recv_counts[r], MPI_MIGRATION_PARTICLE, r, 1, mpi_config->particle_flow_world, &requests[n]);
+                if ( send_counts[r] )  MPI_Isend(migration_send_buffer + send_displs[r], send_counts[r], MPI_MIGRATION_PARTICLE, r, 1, mpi_config->particle_flow_world, &requests[neighbours + n]);
+            }
+            MPI_Waitall(requests.size(), requests.data(), MPI_STATUSES_IGNORE);
+        }
+
+        for ( uint64_t i = 0; i < recv_size; i++ )
+        {
+            particles.append(migration_recv_buffer[i]);
+            add_cell_particle_fields(migration_recv_buffer[i].cell, migration_recv_buffer[i].particle_cell_fields);
+        }
+
+        // Particles which left deposited their source terms in blocks owned by other ranks, drop them. The owners add them with the particles.
+        for ( uint64_t b = 0; b < mesh->num_blocks; b++ )
+        {
+            if ( block_owners[b] != mpi_config->particle_flow_rank )
+                cell_particle_field_map[b].clear();
+        }
+
+        logger.migrated_particles += migrating_particles.size();
+        logger.global_migrations  += global_migration;
+
+        performance_logger.my_papi_stop(performance_logger.migration_event_counts, &performance_logger.migration_time);
+    }
+
+    template<class T>
+    void ParticleSolver<T>::rebalance_particles()
+    {
+        const double kernel_time = performance_logger.particle_interpolation_time + performance_logger.spray_time + performance_logger.position_time + performance_logger.fused_kernel_time;
+
+        performance_logger.my_papi_start();
+
+        if (PARTICLE_SOLVER_DEBUG && mpi_config->rank == mpi_config->particle_flow_rank )  printf("\tRank %d: Running fn: rebalance_particles.\n", mpi_config->rank);
+
+        const int ranks = mpi_config->particle_flow_world_size;
+
+        // Kernel time since the last check, and current particle count, of every particle rank.
+        double load[2] = { kernel_time - rebalance_kernel_time, (double)particles.size() };
+        double loads[2 * ranks];
+        MPI_Allgather(load, 2, MPI_DOUBLE, loads, 2, MPI_DOUBLE, mpi_config->particle_flow_world);
+        rebalance_kernel_time = kernel_time;
+
+        double total_time = 0., max_time = 0., total_particles = 0.;
+        for ( int r = 0; r < ranks; r++ )
+        {
+            total_time      += loads[2*r];
+            total_particles += loads[2*r + 1];
+            max_time         = max(max_time, loads[2*r]);
+        }
+
+        if ( total_particles == 0. || total_time == 0. || max_time <= (1. + rebalance_hysteresis) * (total_time / ranks) )
+        {
+            performance_logger.my_papi_stop(performance_logger.migration_event_counts, &performance_logger.migration_time);
+            return;
+        }
+
+        // Particles per second of each rank. Ranks without particles to time are assumed to be average.
+        double throughputs[ranks];
+        double total_throughput = 0.;
+        for ( int r = 0; r < ranks; r++ )
+        {
+            throughputs[r]    = (loads[2*r] > 0. && loads[2*r + 1] > 0.) ? loads[2*r + 1] / loads[2*r] : total_particles / total_time;
+            total_throughput += throughputs[r];
+        }
+
+        if ( decompose_particles )
+        {
+            rebalance_blocks(throughputs, total_throughput);
+            performance_logger.my_papi_stop(performance_logger.migration_event_counts, &performance_logger.migration_time);
+            return;
+        }
+
+        // Every rank computes the same transfer plan, greedily matching surplus ranks to deficit ranks in rank order.
+        int64_t surplus[ranks];
+        for ( int r = 0; r < ranks; r++ )
+            surplus[r] = (int64_t)loads[2*r + 1] - (int64_t)(total_particles * throughputs[r] / total_throughput);
+
+        int send_counts[ranks], recv_counts[ranks], send_displs[ranks], recv_displs[ranks];
+        for ( int r = 0; r < ranks; r++ )
+        {
+            send_counts[r] = 0;
+            recv_counts[r] = 0;
+        }
+
+        int sender = 0, reciever = 0;
+        while ( true )
+        {
+            while ( sender   < ranks && surplus[sender]   <= 0 )  sender++;
+            while ( reciever < ranks && surplus[reciever] >= 0 )  reciever++;
+            if ( sender == ranks || reciever == ranks )  break;
+
+            const int64_t transfer = min(surplus[sender], -surplus[reciever]);
+            surplus[sender]   -= transfer;
+            surplus[reciever] += transfer;
+
+            if ( sender   == mpi_config->particle_flow_rank )  send_counts[reciever] = transfer;
+            if ( reciever == mpi_config->particle_flow_rank )  recv_counts[sender]   = transfer;
+        }
+
+        send_displs[0] = 0;
+        recv_displs[0] = 0;
+        for ( int r = 1; r < ranks; r++ )
+        {
+            send_displs[r] = send_displs[r - 1] + send_counts[r - 1];
+            recv_displs[r] = recv_displs[r - 1] + recv_counts[r - 1];
+        }
+        const uint64_t send_size = send_displs[ranks - 1] + send_counts[ranks - 1];
+        const uint64_t recv_size = recv_displs[ranks - 1] + recv_counts[ranks - 1];
+
+        if ( rebalance_send_buffer_size < send_size )
+        {
+            rebalance_send_buffer_size = 2 * send_size;
+            rebalance_send_buffer      = (particle_state_aos<T> *)realloc(rebalance_send_buffer, rebalance_send_buffer_size * sizeof(particle_state_aos<T>));
+        }
+        if ( rebalance_recv_buffer_size < recv_size )
+        {
+            rebalance_recv_buffer_size = 2 * recv_size;
+            rebalance_recv_buffer      = (particle_state_aos<T> *)realloc(rebalance_recv_buffer, rebalance_recv_buffer_size * sizeof(particle_state_aos<T>));
+        }
+
+        // Source terms of sent particles have already been accumulated here, only their state moves.
+        for ( uint64_t i = 0; i < send_size; i++ )
+        {
+            rebalance_send_buffer[i] = particles.get_state(particles.size() - 1);
+            particles.pop_back();
+        }
+
+        MPI_Alltoallv(rebalance_send_buffer, send_counts, send_displs, MPI_PARTICLE_STATE, 
+                      rebalance_recv_buffer, recv_counts, recv_displs, MPI_PARTICLE_STATE, mpi_config->particle_flow_world);
+
+        // Register the cells of recieved particles so their nodes are requested from the flow ranks.
+        logger.rebalances++;
+
+        const particle_aos<T> zero_field = {{0.0, 0.0, 0.0}, 0.0, 0.0};
+        for ( uint64_t i = 0; i < recv_size; i++ )
+        {
+            particles.append(rebalance_recv_buffer[i]);
+            add_cell_particle_fields(rebalance_recv_buffer[i].cell, zero_field);
+        }
+
+        logger.rebalanced_particles += send_size;
+
+        performance_logger.my_papi_stop(performance_logger.migration_event_counts, &performance_logger.migration_time);
+    }
+
+    template<class T>
+    void ParticleSolver<T>::rebalance_blocks(const double *rank_throughputs, double total_throughput)
+    {
+        // Particles are tied to the owner of their block, so reassign contiguous block ranges in proportion to rank throughput.
+        // Particles in blocks which changed owner move in the next migrate_particles.
+        const int ranks = mpi_config->particle_flow_world_size;
+
+        uint64_t local_block_particles[mesh->num_blocks], block_particles[mesh->num_blocks];
+        for ( uint64_t b = 0; b < mesh->num_blocks; b++ )
+            local_block_particles[b] = 0;
+        for ( uint64_t p = 0; p < particles.size(); p++ )
+            local_block_particles[mesh->get_block_id(particles.cell[p])]++;
+
+        MPI_Allreduce(local_block_particles, block_particles, mesh->num_blocks, MPI_UINT64_T, MPI_SUM, mpi_config->particle_flow_world);
+
+        double total_particles = 0.;
+        for ( uint64_t b = 0; b < mesh->num_blocks; b++ )
+            total_particles += block_particles[b];
+
+        int    new_owners[mesh->num_blocks];
+        int    rank              = 0;
+        double target_particles  = total_particles * rank_throughputs[0] / total_throughput;
+        double counted_particles = 0.;
+        for ( uint64_t b = 0; b < mesh->num_blocks; b++ )
+        {
+            // Move on once the midpoint of this block passes the current rank's cumulative target.
+            while ( rank < ranks - 1 && counted_particles + 0.5 * block_particles[b] > target_particles )
+            {
+                rank++;
+                target_particles += total_particles * rank_throughputs[rank] / total_throughput;
+            }
+
+            new_owners[b]      = rank;
+            counted_particles += block_particles[b];
+        }
+
+        // Blocks are coarse, only move them if the predicted slowest rank gets faster by more than the hysteresis.
+        double old_times[ranks], new_times[ranks];
+        for ( int r = 0; r < ranks; r++ )
+        {
+            old_times[r] = 0.;
+            new_times[r] = 0.;
+        }
+        for ( uint64_t b = 0; b < mesh->num_blocks; b++ )
+        {
+            old_times[block_owners[b]] += block_particles[b] / rank_throughputs[block_owners[b]];
+            new_times[new_owners[b]]   += block_particles[b] / rank_throughputs[new_owners[b]];
+        }
+        if ( (1. + rebalance_hysteresis) * *max_element(new_times, new_times + ranks) >= *max_element(old_times, old_times + ranks) )
+            return;
+
+        logger.rebalances++;
+
+        for ( uint64_t b = 0; b < mesh->num_blocks; b++ )
+        {
+            if ( block_owners[b] == mpi_config->particle_flow_rank && new_owners[b] != mpi_config->particle_flow_rank )
+                logger.rebalanced_particles += local_block_particles[b];
+
+            block_owners[b] = new_owners[b];
+        }
+
+        set_migration_neighbours();
+        migrate_all = true;
+    }
+
+    template<class T>
+    void ParticleSolver<T>::merge_cell_particle_fields(uint64_t block_id, const uint64_t *cells, const particle_aos<T> *fields, uint64_t size)
+    {
+        uint64_t elements [mesh->num_blocks];
+        for (uint64_t b = 0; b < mesh->num_blocks; b++)
+            elements[b] = 0;
+
+        elements[block_id] = cell_particle_field_map[block_id].size() + size;
+        resize_cell_particle(elements, NULL, NULL);
+
+        for (uint64_t i = 0; i < size; i++)
+        {
+            const uint64_t cell = cells[i];
+
+            if ( const uint64_t *cell_index = cell_particle_field_map[block_id].find(cell) )
+            {
+                const uint64_t index = *cell_index;
+
+                cell_particle_aos[block_id][index].momentum += fields[i].momentum;
+                cell_particle_aos[block_id][index].energy   += fields[i].energy;
+                cell_particle_aos[block_id][index].fuel     += fields[i].fuel;
+
+                logger.aggregated_cells++;
+            }
+            else
+            {
+                const uint64_t index = cell_particle_field_map[block_id].size();
+
+                cell_particle_indexes[block_id][index]  = cell;
+                cell_particle_aos[block_id][index]      = fields[i];
+                cell_particle_field_map[block_id][cell] = index;
+            }
+        }
+    }
+
+    template<class T>
+    void ParticleSolver<T>::aggregate_cell_particle_fields()
+    {
+        // Sum cell source terms across particle ranks, first on each node, then up a binomial tree of node leaders rooted at (block % leaders).
+        // Only the root sends a block's cells to its flow rank, the rest of the tree recieves nodes back through distribute_aggregated_nodes.
+        const uint64_t num_blocks = mesh->num_blocks;
+        const int      node_size  = mpi_config->particle_node_world_size;
+
+        aggregation_children.clear();
+        aggregation_parents.clear();
+
+        if ( node_size > 1 )
+        {
+            if ( mpi_config->particle_node_rank == 0 )  node_member_counts.resize(node_size * num_blocks);
+
+            for (uint64_t b = 0; b < num_blocks; b++)
+                send_counts[b] = (mpi_config->particle_node_rank == 0) ? 0 : cell_particle_field_map[b].size();
+
+            MPI_Gather(send_counts, num_blocks, MPI_UINT64_T, node_member_counts.data(), num_blocks, MPI_UINT64_T, 0, mpi_config->particle_node_world);
+
+            int send_size = 0;
+            for (uint64_t b = 0; b < num_blocks; b++)
+                send_size += send_counts[b];
+
+            aggregation_indexes.resize(send_size);
+            node_member_fields.resize(send_size);
+
+            uint64_t disp = 0;
+            for (uint64_t b = 0; b < num_blocks; b++)
+            {
+                memcpy(aggregation_indexes.data() + disp, cell_particle_indexes[b], send_counts[b] * sizeof(uint64_t));
+                memcpy(node_member_fields.data()  + disp, cell_particle_aos[b],     send_counts[b] * sizeof(particle_aos<T>));
+                disp += send_counts[b];
+            }
+
+            int member_sizes[node_size], member_disps[node_size];
+            if ( mpi_config->particle_node_rank == 0 )
+            {
+                int total_size = 0;
+                for (int m = 0; m < node_size; m++)
+                {
+                    member_sizes[m] = 0;
+                    for (uint64_t b = 0; b < num_blocks; b++)
+                        member_sizes[m] += node_member_counts[m * num_blocks + b];
+                    member_disps[m] = total_size;
+                    total_size     += member_sizes[m];
+                }
+                node_member_cells.resize(total_size);
+            }
+
+            vector<particle_aos<T>> member_fields((mpi_config->particle_node_rank == 0) ? node_member_cells.size() : 0);
+            MPI_Gatherv(aggregation_indexes.data(), send_size, MPI_UINT64_T,                       node_member_cells.data(), member_sizes, member_disps, MPI_UINT64_T,                       0, mpi_config->particle_node_world);
+            MPI_Gatherv(node_member_fields.data(),  send_size, mpi_config->MPI_PARTICLE_STRUCTURE, member_fields.data(),     member_sizes, member_disps, mpi_config->MPI_PARTICLE_STRUCTURE, 0, mpi_config->particle_node_world);
+
+            if ( mpi_config->particle_node_rank == 0 )
+            {
+                for (int m = 1; m < node_size; m++)
+                {
+                    uint64_t member_disp = member_disps[m];
+                    for (uint64_t b = 0; b < num_blocks; b++)
+                    {
+                        const uint64_t size = node_member_counts[m * num_blocks + b];
+                        merge_cell_particle_fields(b, node_member_cells.data() + member_disp, member_fields.data() + member_disp, size);
+                        member_disp += size;
+                    }
+                }
+            }
+            else
+            {
+                for (uint64_t b = 0; b < num_blocks; b++)
+                    cell_particle_field_map[b].clear();
+                return;
+            }
+        }
+
+        const int leaders     = mpi_config->particle_leader_world_size;
+        const int leader_rank = mpi_config->particle_leader_rank;
+
+        vector<MPI_Request> requests;
+        vector<uint64_t>    sent_blocks;
+        for (int step = 1; step < leaders; step *= 2)
+        {
+            requests.clear();
+            sent_blocks.clear();
+
+            for (uint64_t b = 0; b < num_blocks; b++)
+            {
+                const int root  = b % leaders;
+                const int alias = (leader_rank - root + leaders) % leaders;
+
+                if ( alias % (2 * step) != step )  continue;
+
+                const int      parent = (alias - step + root) % leaders;
+                const uint64_t size   = cell_particle_field_map[b].size();
+
+                requests.push_back(MPI_REQUEST_NULL);
+                requests.push_back(MPI_REQUEST_NULL);
+                MPI_Isend(cell_particle_indexes[b], size, MPI_UINT64_T,                       parent, b, mpi_config->particle_leader_world, &requests[requests.size() - 2]);
+                MPI_Isend(cell_particle_aos[b],     size, mpi_config->MPI_PARTICLE_STRUCTURE, parent, b, mpi_config->particle_leader_world, &requests[requests.size() - 1]);
+
+                sent_blocks.push_back(b);
+                if ( size )  aggregation_parents.push_back({b, parent, step, {}, {}, {}});
+            }
+
+            for (uint64_t b = 0; b < num_blocks; b++)
+            {
+                const int root  = b % leaders;
+                const int alias = (leader_rank - root + leaders) % leaders;
+
+                if ( (alias % (2 * step) != 0) || (alias + step >= leaders) )  continue;
+
+                const int child = (alias + step + root) % leaders;
+
+                int size;
+                MPI_Status status;
+                MPI_Probe(child, b, mpi_config->particle_leader_world, &status);
+                MPI_Get_count(&status, MPI_UINT64_T, &size);
+
+                aggregation_indexes.resize(size);
+                node_member_fields.resize(size);
+                MPI_Recv(aggregation_indexes.data(), size, MPI_UINT64_T,                       child, b, mpi_config->particle_leader_world, MPI_STATUS_IGNORE);
+                MPI_Recv(node_member_fields.data(),  size, mpi_config->MPI_PARTICLE_STRUCTURE, child, b, mpi_config->particle_leader_world, MPI_STATUS_IGNORE);
+
+                merge_cell_particle_fields(b, aggregation_indexes.data(), node_member_fields.data(), size);
+
+                if ( size )  aggregation_children.push_back({b, child, step, aggregation_indexes, {}, {}});
+            }
+
+            MPI_Waitall(requests.size(), requests.data(), MPI_STATUSES_IGNORE);
+
+            for (uint64_t b : sent_blocks)
+                cell_particle_field_map[b].clear();
+        }
+    }
+
+    template<class T>
+    void ParticleSolver<T>::distribute_aggregated_nodes()
+    {
+        // Reverse of aggregate_cell_particle_fields. Each parent sends back the nodes of the cells it recieved from each child.
+        const uint64_t num_blocks = mesh->num_blocks;
+        const int      node_size  = mpi_config->particle_node_world_size;
+        const uint64_t cell_size  = mesh->cell_size;
+
+        auto get_cell_nodes = [&] (uint64_t block_id, const uint64_t *cells, uint64_t size, vector<uint64_t>& node_indexes, vector<flow_aos<T>>& node_flow_fields)
+        {
+            aggregation_node_set.clear();
+            for (uint64_t i = 0; i < size; i++)
+            {
+                for (uint64_t n = 0; n < cell_size; n++)
+                {
+                    const uint64_t node = mesh->cells[(cells[i] - mesh->shmem_cell_disp) * cell_size + n];
+                    if ( !aggregation_node_set.insert(node).second )  continue;
+
+                    if (PARTICLE_SOLVER_DEBUG && !node_flow_cache[block_id].count(node))
+                        {printf("ERROR AGGREGATION: Rank %d block %lu node %lu missing from node cache\n", mpi_config->rank, block_id, node); exit(1);}
+
+                    node_indexes.push_back(node);
+                    node_flow_fields.push_back(node_flow_cache[block_id][node].flow);
+                }
+            }
+        };
+
+        if ( mpi_config->particle_node_rank == 0 )
+        {
+            const int leaders = mpi_config->particle_leader_world_size;
+            int top_step = 1;
+            while ( 2 * top_step < leaders )  top_step *= 2;
+
+            vector<MPI_Request> requests;
+            for (int step = top_step; step >= 1 && leaders > 1; step /= 2)
+            {
+                requests.clear();
+                for (aggregation_link& child : aggregation_children)
+                {
+                    if ( child.step != step )  continue;
+
+                    child.node_indexes.clear();
+                    child.node_flow_fields.clear();
+                    get_cell_nodes(child.block, child.cells.data(), child.cells.size(), child.node_indexes, child.node_flow_fields);
+
+                    requests.push_back(MPI_REQUEST_NULL);
+                    requests.push_back(MPI_REQUEST_NULL);
+                    MPI_Isend(child.node_indexes.data(),     child.node_indexes.size(),     MPI_UINT64_T,                   child.rank, child.block, mpi_config->particle_leader_world, &requests[requests.size() - 2]);
+                    MPI_Isend(child.node_flow_fields.data(), child.node_flow_fields.size(), mpi_config->MPI_FLOW_STRUCTURE, child.rank, child.block, mpi_config->particle_leader_world, &requests[requests.size() - 1]);
+                }
+
+                for (aggregation_link& parent : aggregation_parents)
+                {
+                    if ( parent.step != step )  continue;
+
+                    int size;
+                    MPI_Status status;
+                    MPI_Probe(parent.rank, parent.block, mpi_config->particle_leader_world, &status);
+                    MPI_Get_count(&status, MPI_UINT64_T, &size);
+
+                    aggregation_indexes.resize(size);
+                    aggregation_flow_fields.resize(size);
+                    MPI_Recv(aggregation_indexes.data(),     size, MPI_UINT64_T,                   parent.rank, parent.block, mpi_config->particle_leader_world, MPI_STATUS_IGNORE);
+                    MPI_Recv(aggregation_flow_fields.data(), size, mpi_config->MPI_FLOW_STRUCTURE, parent.rank, parent.block, mpi_config->particle_leader_world, MPI_STATUS_IGNORE);
+
+                    for (int i = 0; i < size; i++)
+                        cache_node_flow(parent.block, aggregation_indexes[i], aggregation_flow_fields[i]);
+                    logger.nodes_recieved += size;
+                }
+
+                MPI_Waitall(requests.size(), requests.data(), MPI_STATUSES_IGNORE);
+            }
+        }
+
+        if ( node_size > 1 )
+        {
+            int member_sizes[node_size], member_disps[node_size];
+            vector<uint64_t>    node_counts(node_size * num_blocks);
+            vector<uint64_t>    node_indexes;
+            vector<flow_aos<T>> node_flow_fields;
+
+            if ( mpi_config->particle_node_rank == 0 )
+            {
+                uint64_t member_disp = 0;
+                for (int m = 0; m < node_size; m++)
+                {
+                    member_disps[m] = node_indexes.size();
+                    for (uint64_t b = 0; b < num_blocks; b++)
+                    {
+                        const uint64_t size   = node_member_counts[m * num_blocks + b];
+                        const uint64_t before = node_indexes.size();
+
+                        get_cell_nodes(b, node_member_cells.data() + member_disp, size, node_indexes, node_flow_fields);
+
+                        node_counts[m * num_blocks + b] = node_indexes.size() - before;
+                        member_disp += size;
+                    }
+                    member_sizes[m] = node_indexes.size() - member_disps[m];
+                }
+            }
+
+            MPI_Scatter(node_counts.data(), num_blocks, MPI_UINT64_T, send_counts, num_blocks, MPI_UINT64_T, 0, mpi_config->particle_node_world);
+
+            int recv_size = 0;
+            for (uint64_t b = 0; b < num_blocks; b++)
+                recv_size += send_counts[b];
+
+            aggregation_indexes.resize(recv_size);
+            aggregation_flow_fields.resize(recv_size);
+            MPI_Scatterv(node_indexes.data(),     member_sizes, member_disps, MPI_UINT64_T,                   aggregation_indexes.data(),     recv_size, MPI_UINT64_T,                   0, mpi_config->particle_node_world);
+            MPI_Scatterv(node_flow_fields.data(), member_sizes, member_disps, mpi_config->MPI_FLOW_STRUCTURE, aggregation_flow_fields.data(), recv_size, mpi_config->MPI_FLOW_STRUCTURE, 0, mpi_config->particle_node_world);
+
+            if ( mpi_config->particle_node_rank != 0 )
+            {
+                uint64_t disp = 0;
+                for (uint64_t b = 0; b < num_blocks; b++)
+                {
+                    for (uint64_t i = disp; i < disp + send_counts[b]; i++)
+                        cache_node_flow(b, aggregation_indexes[i], aggregation_flow_fields[i]);
+                    disp += send_counts[b];
+                }
+                logger.nodes_recieved += recv_size;
+            }
+        }
+    }
+
+    template<class T> 
+    void ParticleSolver<T>::update_flow_field()
+    {
+        performance_logger.my_papi_start();
+
+        active_blocks.clear();
+        recieved_nodes = 0;
+
+        evict_node_flow_cache();
+
+        if ( aggregate_source_terms )
+        {
+            for (uint64_t b = 0; b < mesh->num_blocks; b++)
+                cell_particle_field_map[b].erase(MESH_BOUNDARY);
+
+            aggregate_cell_particle_fields();
+        }
+
+        double avg_sent_cells  = 0.;
+        double non_zero_blocks = 0.;
+
+        for (uint64_t b = 0; b < mesh->num_blocks; b++)
+        {
+            cell_particle_field_map[b].erase(MESH_BOUNDARY);
+            uint64_t cell_size = cell_particle_field_map[b].size();
+
+            logger.sent_cells += cell_size;
+            avg_sent_cells    += cell_size;
+            non_zero_blocks   += cell_size > 0;
+
+            neighbours_size[b]   = cell_size;
+            
+            if ( cell_size )
+            {
+                active_blocks.push_back(b);
+                if (statuses.size() < active_blocks.size())
+                {
+                    MPI_Status mpi_status = { 0, 0, 0, 0, 0};
+                    statuses.push_back( mpi_status );
+
+                    send_requests.push_back( MPI_REQUEST_NULL );
+                    send_requests.push_back( MPI_REQUEST_NULL );
+                    recv_requests.push_back( MPI_REQUEST_NULL );
+                    recv_requests.push_back( MPI_REQUEST_NULL );
+                }
+            }
+        }
+        if ( non_zero_blocks )
+        {
+            avg_sent_cells              /= non_zero_blocks;
+            logger.sent_cells_per_block += avg_sent_cells;
+        }
+
+        // MPI_Barrier(mpi_config->world);
+
+
+        if ( PARTICLE_SOLVER_DEBUG && mpi_config->rank == mpi_config->particle_flow_rank )  printf("\tRank %d: Running fn: update_flow_field.\n", mpi_config->rank);
+        if ( PARTICLE_SOLVER_DEBUG && mpi_config->rank == mpi_config->particle_flow_rank )  printf("\tRank %d: Sending index sizes.\n", mpi_config->rank);
+
+        // Stamp the nodes requested from each block, as the flow ranks do in sent_node_cache. Nodes new to the cache are
+        // filled when they are recieved.
+        for (uint64_t b : active_blocks)
+        {
+            for (uint64_t i = 0; i < cell_particle_field_map[b].size(); i++)
+            {
+                for (uint64_t n = 0; n < mesh->cell_size; n++)
+                    node_flow_cache[b][mesh->cells[(cell_particle_indexes[b][i] - mesh->shmem_cell_disp) * mesh->cell_size + n]].version = timestep_count;
+            }
+        }
+
+        uint64_t count = 0;
+        for (uint64_t b : active_blocks)
+        {
+            neighbours_size[b] = cell_particle_field_map[b].size();
+            if ( PARTICLE_SOLVER_DEBUG && mpi_config->rank == mpi_config->particle_flow_rank )  printf("\tRank %d: Sending %d indexes to block %lu.\n", mpi_config->rank, neighbours_size[b], b);
+
+            // MPI_Isend(&neighbours_size[b],      1,                  MPI_INT,                             mpi_config->particle_flow_world_size + b, 0, mpi_config->world, &send_requests[count] );
+            if ( coupling_codec.enabled() )
+            {
+                uint8_t *encoded_buffer;
+                const size_t encoded_size = coupling_codec.encode(b, cell_particle_indexes[b], cell_particle_aos[b], neighbours_size[b], &encoded_buffer);
+                MPI_Issend(encoded_buffer, encoded_size, MPI_BYTE, mpi_config->particle_flow_world_size + b, 0, mpi_config->world, &send_requests[count++  + 0*active_blocks.size()] );
+                continue;
+            }
+
+            MPI_Issend(cell_particle_indexes[b], neighbours_size[b], MPI_UINT64_T,                        mpi_config->particle_flow_world_size + b, 0, mpi_config->world, &send_requests[count  + 0*active_blocks.size()] );
+            MPI_Isend(cell_particle_aos[b],     neighbours_size[b], mpi_config->MPI_PARTICLE_STRUCTURE,  mpi_config->particle_flow_world_size + b, 2, mpi_config->world, &send_requests[count++ + 1*active_blocks.size()] );
+        }
+
+
+        MPI_Waitall(active_blocks.size(), send_requests.data(), MPI_STATUSES_IGNORE);
+
+        if ( PARTICLE_SOLVER_DEBUG && mpi_config->rank == mpi_config->particle_flow_rank )  printf("\tRank %d: Wait has returned successfully\n", mpi_config->rank);
+        MPI_Barrier(mpi_config->particle_flow_world);
+
+        int sends_done = 1;
+        if ( PARTICLE_SOLVER_DEBUG && mpi_config->rank == mpi_config->particle_flow_rank )  printf("\tRank %d: All index sizes sent.\n", mpi_config->rank);
+        
+        MPI_Ibcast(&sends_done, 1, MPI_INT, 0, mpi_config->world, &bcast_request);
+
+        for (uint64_t b : active_blocks)
+            cell_particle_field_map[b].clear();
+
+        uint64_t posted_recvs = 0;
+        uint64_t ba = active_blocks.size() - 1;
+        uint64_t bi;
+        bool     all_processed      = true;
+        bool    *posted_block_recvs = async_locks;
+        bool    *processed_block    = async_locks + active_blocks.size();
+        for ( uint64_t ba = 0; ba < active_blocks.size(); ba++ )  
+        {
+            posted_block_recvs[ba]  = false;
+            processed_block[ba]     = false;
+            all_processed       &= processed_block[ba];
+        }
+        
+        while (!all_processed)
+        {
+            ba = (ba + 1) % active_blocks.size();
+            bi = active_blocks[ba];
+
+            int message_waiting = 0;
+            MPI_Iprobe (MPI_ANY_SOURCE, 0, mpi_config->world, &message_waiting, &statuses[posted_recvs] );
+
+            if ( message_waiting && (posted_recvs < active_blocks.size()) )
+            {
+                const uint64_t send_rank = statuses[posted_recvs].MPI_SOURCE;
+                const uint64_t block_id  = statuses[posted_recvs].MPI_SOURCE - mpi_config->particle_flow_world_size;
+                int active_block_index   = find(active_blocks.begin(), active_blocks.end(), block_id) - active_blocks.begin(); 
+
+                if ( coupling_codec.enabled() )
+                {
+                    // Ids and fields arrive as one encoded message, decoded once the recieve completes.
+                    int encoded_size;
+                    MPI_Get_count( &statuses[posted_recvs], MPI_BYTE, &encoded_size );
+                    uint8_t *encoded_buffer = coupling_codec.get_buffer(mesh->num_blocks + block_id, encoded_size);
+
+                    MPI_Irecv ( encoded_buffer, encoded_size, MPI_BYTE, send_rank, 0, mpi_config->world, &recv_requests[active_block_index] );
+                    recv_requests[active_block_index + active_blocks.size()] = MPI_REQUEST_NULL;
+
+                    posted_block_recvs[active_block_index] = true;
+                    posted_recvs++;
+                    continue;
+                }
+
+                MPI_Get_count( &statuses[posted_recvs], MPI_UINT64_T, &neighbours_size[block_id] );
+                resize_nodes_arrays(neighbours_size[block_id] + 1, block_id);
+
+                logger.nodes_recieved += neighbours_size[block_id];
+
+                if ( PARTICLE_SOLVER_DEBUG )  printf("\tRank %d: Posted %d recieves (ptr %p) for flow block %lu (slots %d %ld max %ld) .\n", mpi_config->rank, neighbours_size[block_id], all_interp_node_indexes[block_id], block_id, active_block_index, active_block_index + active_blocks.size(), recv_requests.size() );
+                MPI_Irecv ( all_interp_node_indexes[block_id],     neighbours_size[block_id], MPI_UINT64_T,                   send_rank, 0, mpi_config->world, &recv_requests[active_block_index] );
+                MPI_Irecv ( all_interp_node_flow_fields[block_id], neighbours_size[block_id], mpi_config->MPI_FLOW_STRUCTURE, send_rank, 1, mpi_config->world, &recv_requests[active_block_index + active_blocks.size()] );
+
+                posted_block_recvs[active_block_index] = true;
+                posted_recvs++;
+                continue;
+            }
+
+            int recieve_done = 0, fields_recieve_done = 0;
+            MPI_Test(&recv_requests[ba],                        &recieve_done,        MPI_STATUS_IGNORE);
+            MPI_Test(&recv_requests[ba + active_blocks.size()], &fields_recieve_done, MPI_STATUS_IGNORE);
+            recieve_done &= fields_recieve_done;
+
+            if ( recieve_done && !processed_block[ba] && posted_block_recvs[ba] )
+            {
+                // uint64_t size_before = requested_nodes.size();
+
+                if ( coupling_codec.enabled() )
+                {
+                    const uint8_t *encoded_buffer = coupling_codec.get_buffer(mesh->num_blocks + bi, 0);
+
+                    neighbours_size[bi] = coupling_codec.decode_size(encoded_buffer);
+                    resize_nodes_arrays(neighbours_size[bi] + 1, bi);
+                    coupling_codec.decode(encoded_buffer, all_interp_node_indexes[bi], all_interp_node_flow_fields[bi]);
+
+                    logger.nodes_recieved += neighbours_size[bi];
+                }
+
+                // if ( PARTICLE_SOLVER_DEBUG )  
+                // {
+                //     printf("\tRank %d: Indexes (%p ptr) load finished for flow block %lu (slots %lu ) .\n", mpi_config->rank, all_interp_node_indexes[bi], bi, ba );
+
+                //     if      ( (uint64_t) neighbours_size[bi]  >= (node_flow_array_sizes[bi]   / sizeof(flow_aos<T>)) )
+                //         {printf("ERROR RECV VALS : Rank %d Block %lu will write indexes to unallocated memory required size %d max %lu\n", mpi_config->rank, bi, neighbours_size[bi], node_flow_array_sizes[bi] / sizeof(flow_aos<T>)); exit(1);}
+                //     else if ( (uint64_t) neighbours_size[bi]  >= (node_index_array_sizes[bi]  / sizeof(uint64_t)) )
+                //         {printf("ERROR RECV VALS : Rank %d Block %lu will write fields  to unallocated memory required size %d max %lu\n", mpi_config->rank, bi, neighbours_size[bi], node_index_array_sizes[bi] / sizeof(uint64_t)); exit(1);}
+                // }
+
+                #pragma ivdep
+                for (int i = 0; i < neighbours_size[bi]; i++)
+                {
+                    // Flow ranks only send nodes which have changed since they were last sent to this rank, keep the rest cached.
+                    cache_node_flow(bi, all_interp_node_indexes[bi][i], all_interp_node_flow_fields[bi][i]);
+
+                    // if (PARTICLE_SOLVER_DEBUG && all_interp_node_indexes[bi][i] > mesh->points_size )
+                    //     {printf("ERROR RECV VALS : Rank %d Flow block %lu Value %lu out of range at %d\n", mpi_config->rank, bi, all_interp_node_indexes[bi][i], i); exit(1);}
+                }
+
+                // if (PARTICLE_SOLVER_DEBUG && size_before != requested_nodes.size())
+                //     {printf("\tRank %d: Recieving wrong amount of data(+%lu). Block %lu Node map size %ld sent size %d.\n", mpi_config->rank, requested_nodes.size() - size_before, bi, requested_nodes.size(), neighbours_size[bi] ); exit(1);};
+                    
+                processed_block[ba] = true;
+            }
+
+            all_processed = true;
+            for (uint64_t b = 0; b < active_blocks.size(); b++ )  all_processed &= processed_block[b];
+        }
+
+        MPI_Waitall( recv_requests.size(), recv_requests.data(), MPI_STATUSES_IGNORE);
+
+        // Complete the broadcast before sends_done goes out of scope. Flow ranks finished it before sending their nodes back,
+        // otherwise it lands in whatever is on the stack later (such as the migration counts).
+        MPI_Wait(&bcast_request, MPI_STATUS_IGNORE);
+
+        if ( aggregate_source_terms )
+            distribute_aggregated_nodes();
+
+        logger.useful_nodes_proportion += requested_nodes.size();
+
+        // Requested nodes which weren't recieved are served from the node cache.
+        logger.cached_nodes += requested_nodes.size() - recieved_nodes;
+        
+        // MPI_Barrier(mpi_config->world);
+        if ( PARTICLE_SOLVER_DEBUG && mpi_config->rank == mpi_config->particle_flow_rank )  printf("\tRank %d: Completed comms.\n", mpi_config->rank);
+        
+
+        performance_logger.my_papi_stop(performance_logger.update_flow_field_event_counts, &performance_logger.update_flow_field_time);
+    }
+            
+    template<class T> 
+    void ParticleSolver<T>::particle_release()
+    {
+        performance_logger.my_papi_start();
+
+        // TODO: Reuse decaying particle space
+        if (PARTICLE_SOLVER_DEBUG && mpi_config->rank == mpi_config->particle_flow_rank )  printf("\tRank %d: Running fn: particle_release.\n", mpi_config->rank);
+        function<void(uint64_t *, uint64_t ***, particle_aos<T> ***)> resize_cell_particles_fn = [this] (uint64_t *elements, uint64_t ***indexes, particle_aos<T> ***cell_particle_fields) { return resize_cell_particle(elements, indexes, cell_particle_fields); };
+
+        particle_dist->emit_particles_evenly(particles, cell_particle_field_map, requested_nodes, cell_particle_indexes, cell_particle_aos, resize_cell_particles_fn, &logger);
+        // particle_dist->emit_particles_waves(particles, cell_particle_field_map, cell_particle_indexes, cell_particle_aos,  &logger);
+
+        performance_logger.my_papi_stop(performance_logger.emit_event_counts, &performance_logger.emit_time);
+    }
+
+    template<class T> 
+    void ParticleSolver<T>::sort_particles()
+    {
+        if ( timestep_count < sort_frequency || timestep_count - sort_timestep < sort_frequency )  return;
+        if ( logger.sorts > 0. && sort_lost_cost < sort_last_cost )                              return;
+
+        if (PARTICLE_SOLVER_DEBUG && mpi_config->rank == mpi_config->particle_flow_rank )  printf("\tRank %d: Running fn: sort_particles.\n", mpi_config->rank);
+
+        const double previous_sort_cost = performance_logger.get_sort_cost();
+
+        performance_logger.my_papi_start();
+        particles.sort_by_cell();
+        performance_logger.my_papi_stop(performance_logger.sort_event_counts, &performance_logger.sort_time);
+
+        sort_last_cost    = performance_logger.get_sort_cost() - previous_sort_cost;
+        sort_lost_cost    = 0.;
+        sort_timestep     = timestep_count;
+        logger.sorts     += 1.;
+        logger.sort_cost += sort_last_cost;
+    }
+
+    template<class T> 
+    void ParticleSolver<T>::measure_sort_benefit()
+    {
+        const double kernel_cost = performance_logger.get_particle_kernel_cost();
+        const double step_cost   = kernel_cost - sort_kernel_cost;
+        sort_kernel_cost         = kernel_cost;
+
+        if ( particles.size() == 0 )  return;
+
+        // Kernel cost is compared per particle, as emission and decay change the particle count between timesteps. The baseline
+        // is the lowest cost per particle since the sort, so fixed per timestep costs being spread over more particles isn't lost.
+        const double particle_cost = step_cost / particles.size();
+        if ( logger.sorts > 0. && sort_timestep == timestep_count )
+        {
+            sort_baseline                = particle_cost;
+            logger.presort_kernel_cost  += sort_step_cost;
+            logger.postsort_kernel_cost += particle_cost;
+            logger.sort_saved_cost      += (sort_step_cost - particle_cost) * particles.size();
+        }
+        else if ( logger.sorts > 0. )
+        {
+            sort_baseline   = min(sort_baseline, particle_cost);
+            sort_lost_cost += (particle_cost - sort_baseline) * particles.size();
+        }
+
+        sort_step_cost = particle_cost;
+    }
+
+    template<class T> 
+    void ParticleSolver<T>::merge_parcels(const uint64_t *group, uint64_t size)
+    {
+        // Merges the parcels group[1..size) into group[0]. Droplets, mass, momentum and thermal energy (mass * temperature, the
+        // droplets share one heat capacity) are summed, and the merged droplets keep the mean droplet volume. Position,
+        // acceleration and age are mass weighted means, so the merged parcel stays inside the cell.
+        if ( size < 2 )  return;
+
+        T      weight = 0., mass = 0., temp = 0., age = 0., volume = 0.;
+        vec<T> x1 = {0., 0., 0.}, v1 = {0., 0., 0.}, a1 = {0., 0., 0.};
+        for ( uint64_t i = 0; i < size; i++ )
+        {
+            const uint64_t p             = group[i];
+            const T        parcel_mass   = particles.weight[p] * particles.mass[p];
+
+            weight += particles.weight[p];
+            mass   += parcel_mass;
+            x1     += parcel_mass * particles.x1.get(p);
+            v1     += parcel_mass * particles.v1.get(p);
+            a1     += parcel_mass * particles.a1.get(p);
+            temp   += parcel_mass * particles.temp[p];
+            age    += parcel_mass * particles.age[p];
+            volume += particles.weight[p] * particles.diameter[p] * particles.diameter[p] * particles.diameter[p];
+
+            if ( i > 0 )  particles.decayed[p] = true;
+        }
+
+        const uint64_t p = group[0];
+        particles.x1.set(p, x1 / mass);
+        particles.v1.set(p, v1 / mass);
+        particles.a1.set(p, a1 / mass);
+        particles.temp[p]     = temp / mass;
+        particles.age[p]      = age  / mass;
+        particles.weight[p]   = weight;
+        particles.mass[p]     = mass / weight;
+        particles.diameter[p] = cbrt(volume / weight);
+
+        logger.merged_particles += size - 1;
+    }
+
+    template<class T> 
+    void ParticleSolver<T>::merge_particles()
+    {
+        if ( timestep_count == 0 || (timestep_count % merge_frequency) != 0 )  return;
+
+        if (PARTICLE_SOLVER_DEBUG && mpi_config->rank == mpi_config->particle_flow_rank )  printf("\tRank %d: Running fn: merge_particles.\n", mpi_config->rank);
+
+        performance_logger.my_papi_start();
+
+        const uint64_t particles_size = particles.size();
+        if ( merge_order_size < particles_size )
+        {
+            merge_order_size = particles.capacity();
+            merge_order      = (uint64_t *)realloc(merge_order, merge_order_size * sizeof(uint64_t));
+        }
+
+        // Group the particles by cell, with each cell's parcels in diameter order so similar droplets are neighbours.
+        for ( uint64_t p = 0; p < particles_size; p++ )
+            merge_order[p] = p;
+        sort(merge_order, merge_order + particles_size, [this] (uint64_t a, uint64_t b) {
+            if ( particles.cell[a]     != particles.cell[b] )      return particles.cell[a]     < particles.cell[b];
+            if ( particles.diameter[a] != particles.diameter[b] )  return particles.diameter[a] < particles.diameter[b];
+            return a < b;
+        });
+
+        for ( uint64_t begin = 0, end; begin < particles_size; begin = end )
+        {
+            const uint64_t cell = particles.cell[merge_order[begin]];
+            for ( end = begin + 1; end < particles_size && particles.cell[merge_order[end]] == cell; end++ );
+
+            if ( end - begin <= max_cell_particles )  continue;
+
+            logger.merged_cells++;
+
+            // Merge each run of parcels similar to the run's first, keeping the merged parcels at the front of the cell's range.
+            uint64_t survivors = begin;
+            for ( uint64_t first = begin, last; first < end; first = last )
+            {
+                const uint64_t f       = merge_order[first];
+                const vec<T>   f_v1    = particles.v1.get(f);
+                const T        f_speed = magnitude(f_v1);
+                for ( last = first + 1; last < end; last++ )
+                {
+                    const uint64_t q = merge_order[last];
+                    if ( particles.diameter[q] > (1. + MERGE_DIAMETER_TOLERANCE) * particles.diameter[f] )                                        break;
+                    if ( magnitude(particles.v1.get(q) - f_v1) > MERGE_VELOCITY_TOLERANCE * max(f_speed, magnitude(particles.v1.get(q))) )  break;
+                }
+
+                merge_parcels(merge_order + first, last - first);
+                merge_order[survivors++] = f;
+            }
+
+            // Still over the cap, merge neighbouring parcels (the closest in diameter) into max_cell_particles groups.
+            const uint64_t remaining = survivors - begin;
+            if ( remaining > max_cell_particles )
+            {
+                for ( uint64_t g = 0; g < max_cell_particles; g++ )
+                {
+                    const uint64_t group_begin = begin + (g       * remaining) / max_cell_particles;
+                    const uint64_t group_end   = begin + ((g + 1) * remaining) / max_cell_particles;
+                    merge_parcels(merge_order + group_begin, group_end - group_begin);
+                }
+            }
+        }
+
+        particles.remove_decayed();
+
+        performance_logger.my_papi_stop(performance_logger.merge_event_counts, &performance_logger.merge_time);
+    }
+
+    template<class T> 
+    spray_step<T> ParticleSolver<T>::spray_substep(particle_state_aos<T>& state, const flow_aos<T>& local_flow_value, T h, particle_aos<T>& fields)
+    {
+        // Inputs from flow: relative_acc, kinematic viscoscity?, air_temp, air_pressure
+        // Scenario constants: omega?, latent_heat, droplet_pressure?, evaporation_constant
+        // Calculated outputs: acceleration, droplet surface temperature, droplet mass, droplet diameter
+        // Calculated outputs for flow: evaporated mass?
+        // One explicit step of length h. Updates the droplet's velocity, acceleration, mass, temperature and diameter (not its
+        // position or age) and adds the step's source terms to fields.
+
+        vec<T> v1     = state.v1;
+        vec<T> a1     = state.a1;
+        T mass        = state.mass;
+        T temp        = state.temp;
+        T diameter    = state.diameter;
+
+        // TODO Add better flop estimates for pow and ln. Also, can we get a fast approximation. Taylor series?
+
+        // TODO: Remove DUMMY_VALs
+        // SOLVE SPRAY/DRAG MODEL  https://www.sciencedirect.com/science/article/pii/S0021999121000826?via%3Dihub7
+        const vec<T> relative_drop_vel           = 0.65 * (local_flow_value.vel - v1);                                         // DUMMY_VAL Relative velocity between droplet and the fluid 
+        const T relative_drop_vel_mag            = magnitude(relative_drop_vel);                         // DUMMY_VAL Relative acceleration between the gas and liquid phase.
+        const vec<T> relative_drop_acc           = a1 * h ;                                                      // DUMMY_VAL Relative acceleration between droplet and the fluid CURRENTLY assumes no change for gas temp
+
+
+        const fuel_properties<T> fuel = fuel_table.evaluate(temp);                // Temperature dependent fuel properties, see FuelPropertyTable.hpp
+
+        const T gas_density  = 6.9;                                               // DUMMY VAL
+        const T fuel_density = fuel.density;
+
+
+        const T omega               = 1.;                                                                  // DUMMY_VAL What is this?
+        const T kinematic_viscosity = 1.48e-5 * pow(local_flow_value.temp, 1.5) / (local_flow_value.temp + 110.4);    // DUMMY_VAL 
+        const T reynolds            = gas_density * relative_drop_vel_mag * diameter / kinematic_viscosity;
+
+        const T droplet_frontal_area  = M_PI * (diameter / 2.) * (diameter / 2.);
+
+        // Drag coefficient
+        const T drag_coefficient = ( reynolds <= 1000. ) ? 24 * (1. + 0.15 * pow(reynolds, 0.687))/reynolds : 0.424;
+        const T drag_scale       = drag_coefficient * reynolds  * 0.5 * gas_density * relative_drop_vel_mag *  droplet_frontal_area;
+
+        // const vec<T> body_force    = Should we account for this?
+        const vec<T> virtual_force = (-0.5 * gas_density * omega) * relative_drop_acc;
+        const vec<T> drag_force    = drag_scale * relative_drop_vel;
+        
+        
+
+        a1 = ((virtual_force + drag_force) / mass);
+        v1 = v1 + a1 * h;
+        
+
+
+        // SOLVE EVAPORATION MODEL https://arc.aiaa.org/doi/pdf/10.2514/3.8264 
+        // Amount of spray evaporation is used in the modified transport equation of mixture fraction (each timestep).
+        const T air_pressure           = local_flow_value.pressure;
+        const T fuel_vapour_pressure   = fuel.vapour_pressure;                                               // DUMMY_VAL fuel vapor at drop surface (kP)
+        const T pressure_relation      = (air_pressure + fuel_vapour_pressure) / fuel_vapour_pressure;       // DUMMY_VAL Clausius-Clapeyron relation. air pressure / fuel vapour pressure.
+        const T molecular_ratio        = 29. / 108.;                                                         // DUMMY_VAL molecular weight air / molecular weight fuel
+        const T mass_fraction_fuel     = 1. / (1. + (pressure_relation - 1.) * molecular_ratio);                // Mass fraction of fuel vapour at the droplet surface  
+        const T mass_fraction_fuel_ref = (2./3.) * mass_fraction_fuel;                                       // Mass fraction of fuel vapour ref at the droplet surface  
+        const T mass_fraction_air_ref  = 1. - mass_fraction_fuel_ref;                                         // Mass fraction of air vapour  ref at the droplet surface  
+
+        const T thermal_conduct_air      = 0.04418;                                                                                                                        // DUMMY_VAL mean thermal conduct. Calc each iteration?
+        const T thermal_conduct_fuel     = fuel.thermal_conductivity;                                                                                                      // DUMMY_VAL mean thermal conductivity. Calc each iteration?
+        const T thermal_conductivity     = mass_fraction_air_ref * thermal_conduct_air + mass_fraction_fuel_ref * thermal_conduct_fuel;                                    // DUMMY_VAL specific heat of the gas
+
+
+        const T specific_heat_fuel       = fuel.specific_heat;                                                                           // DUMMY_VAL specific heat of the gas
+        const T specific_heat_air        = 1044.;                                                                                        // DUMMY_VAL specific heat of the gas
+        const T specific_heat            = mass_fraction_air_ref * specific_heat_air + mass_fraction_fuel_ref * specific_heat_fuel;     // DUMMY_VAL specific heat of the gas
+
+
+        const T mass_transfer        = mass_fraction_fuel / (1. - mass_fraction_fuel);
+        const T log_mass_transfer    = log(1. + mass_transfer);
+        const T mass_delta           = 2. * M_PI * diameter * (thermal_conductivity / specific_heat_fuel) * log_mass_transfer;       // Rate of fuel evaporation
+
+        
+        const T latent_heat       = fuel.latent_heat;                                                                               // DUMMY_VAL Latent heat of fuel vaporization (kJ/kg)
+        const T air_heat_transfer = 2. * M_PI * fuel_vapour_pressure * (local_flow_value.temp - temp) * log_mass_transfer / mass_transfer;   // The heat transferred from air to fuel
+        const T evaporation_heat  = mass_delta * latent_heat;                                                                       // The heat absorbed through evaporation
+        const T temp_delta        = (air_heat_transfer - evaporation_heat) / (specific_heat * mass);                                // Temperature change of the droplet's surface
+
+        const T evaporation_constant = 8. * log_mass_transfer * thermal_conductivity / (fuel_density * specific_heat_fuel);     // Evaporation constant
+
+        // Inverse of the drag relaxation time, and the relative rates of evaporation and heating.
+        const T stiffness = max(max(0.65 * drag_scale / mass, mass_delta / mass), max(evaporation_constant / (diameter * diameter), fabs(temp_delta) / temp));
+
+        temp     = temp + temp_delta * h;
+        mass     = mass - mass_delta * h;
+        diameter = sqrt(diameter * diameter  - evaporation_constant * h);
+
+        // Accumulate particle fields
+        fields.momentum += mass * v1 * h;
+        fields.energy   += (air_heat_transfer - evaporation_heat) * h;
+        fields.fuel     += mass_delta * h;
+
+        state.v1       = v1;
+        state.a1       = a1;
+        state.mass     = mass;
+        state.temp     = temp;
+        state.diameter = diameter;
+
+        return { relative_drop_vel, relative_drop_vel_mag, fuel_density, fuel_vapour_pressure, stiffness };
+    }
+
+    template<class T> 
+    spray_step<T> ParticleSolver<T>::integrate_spray(particle_state_aos<T>& state, const flow_aos<T>& flow, particle_aos<T>& fields, vec<T>& displacement, kernel_thread& thread)
+    {
+        // Integrates the droplet over delta and returns how far it moved rather than moving it. If one step would change the
+        // droplet by more than subcycle_tolerance, the step is discarded and the droplet takes sub-steps, each sized from the
+        // rates of the step before, until delta is covered or the droplet decays.
+        const T critical_temp = FuelPropertyTable<T>::critical_temp;
+        const particle_state_aos<T> start = state;
+
+        spray_step<T> step = spray_substep(state, flow, delta, fields);
+        displacement       = state.v1 * delta;
+        if ( subcycle_tolerance == 0. || delta * step.stiffness <= subcycle_tolerance )  return step;
+
+        state        = start;
+        fields       = particle_aos<T>();
+        displacement = {0.0, 0.0, 0.0};
+
+        T        remaining = delta;
+        uint64_t substeps  = 0;
+        while ( remaining > 0. && !(state.mass < 0 || state.temp > critical_temp) )
+        {
+            const T h = ( ++substeps == SPRAY_MAX_SUBSTEPS ) ? remaining : min(remaining, subcycle_tolerance / step.stiffness);
+
+            step          = spray_substep(state, flow, h, fields);
+            displacement += state.v1 * h;
+            remaining    -= h;
+        }
+
+        if (LOGGER)
+        {
+            thread.logger.subcycled_particles++;
+            thread.logger.spray_substeps     += substeps;
+            thread.logger.max_spray_substeps  = max(thread.logger.max_spray_substeps, (double)substeps);
+        }
+
+        return step;
+    }
+
+    template<class T> 
+    void ParticleSolver<T>::solve_spray(uint64_t p, kernel_thread& thread)
+    {
+        // if (decayed) return;
+
+        particle_state_aos<T> state = particles.get_state(p);
+        const flow_aos<T> local_flow_value = { particles.gas_vel.get(p), particles.gas_pressure[p], particles.gas_temp[p] };
+
+        particle_aos<T> fields;
+        vec<T>          displacement;
+        const spray_step<T> step = integrate_spray(state, local_flow_value, fields, displacement, thread);
+
+        vec<T> x1     = state.x1;
+        vec<T> v1     = state.v1;
+        T mass        = state.mass;
+        T age         = state.age;
+        const T temp         = state.temp;
+        const T diameter     = state.diameter;
+        const T critical_temp = FuelPropertyTable<T>::critical_temp;
+
+        // Store particle fields, for every droplet of the parcel
+        particles.momentum.set(p, state.weight * fields.momentum);
+        particles.energy[p] = state.weight * fields.energy;
+        particles.fuel[p]   = state.weight * fields.fuel;
+
+
+        const bool decayed = (mass < 0 || temp > critical_temp);
+        bool breakup       = false;
+
+
+        if (!decayed)
+        {
+
+            // SOLVE SPRAY BREAKUP MODEL
+            age += delta;
+
+            const T gas_density           = 6.9;                                               // DUMMY VAL
+            const T fuel_density          = step.fuel_density;
+            const T relative_drop_vel_mag = step.relative_drop_vel_mag;
+            const vec<T> relative_drop_vel = step.relative_drop_vel;
+
+            const T breakup_age   = sqrt(fuel_density / (3*gas_density)) * (diameter / (2.0*relative_drop_vel_mag));
+
+            const T surface_tension  = step.fuel_vapour_pressure * diameter / 4;
+            const T weber_droplet    = fuel_density * (relative_drop_vel_mag * relative_drop_vel_mag) * diameter / surface_tension;
+            const T weber_critical   = 0.5;
+
+            if (age > breakup_age && weber_droplet > weber_critical)  // Ternary?
+            {
+                // const T first_moment   = 0.6 * log(weber_critical / weber_droplet); 
+                // const T second_moment  = - first_moment * weber_droplet; 
+                
+                // TODO: How do you get a random number from distribution 0.5 * (1 + erf((x - diameter - first_moment) / sqrt(2*second_moment))); 
+                random_stream rng = { particle_dist->seed, STREAM_BREAKUP, particles.id[p], timestep_count };
+                const T rand_prop = 0.1 + rng.uniform() * (0.9 - 0.1);
+                const T diameter1 = rand_prop * diameter;
+                const T diameter2 = diameter - diameter1;
 
-            cout << endl;
+                const T droplet1_ratio = diameter1 / diameter;
 
-            cout <<"NOTE: REDUCING RELATIVE GAS VEL by 50\% in Particle.hpp while flow isn't implemented!!!" << endl;
-            cout << endl;
+                const T mass1 = droplet1_ratio * mass;
+                const T mass2 = mass - mass1;
+
+                // Product droplet velocity is computed by adding a factor to the parent velocity
+                const T length = diameter / (2.0 * breakup_age);
+
+                vec<T> velocity1 = rng.uniform_vec();
+                vec<T> velocity2 = rng.uniform_vec();
+
+                velocity1 = -1. + (velocity1 * 2.);
+                velocity2 = -1. + (velocity2 * 2.);
+
+                vec<T> unit_rel_velocity = relative_drop_vel / magnitude(relative_drop_vel);
+
+                velocity1 = velocity1 - dot_product(velocity1, unit_rel_velocity) * unit_rel_velocity; 
+                velocity2 = velocity2 - dot_product(velocity2, unit_rel_velocity) * unit_rel_velocity; 
+
+                
+                // Children get a random id with the top bit set, emitted particles count up from 0. Every droplet of a parcel breaks
+                // up, so the child parcel has the parent's weight.
+                thread.breakup_children.push_back(Particle<T>(x1 + (velocity2 * length + v1 * delta), velocity2 * length + v1, state.a1, mass2, temp, diameter2, state.cell, rng.bits() | (1ULL << 63), state.weight));
+
+                // Update parent to droplet1;
+                v1     += velocity1 * length;
+                mass    = mass1;
+                age     = 0.0;
+                breakup = true;
+
+                if (LOGGER)
+                {   
+                    thread.logger.breakups++;
+                    thread.logger.num_particles++;
+                    thread.logger.breakup_age = breakup_age;
+                }
+            }
+
+            if (LOGGER)
+            {   
+                thread.logger.breakup_age = breakup_age;
+            }
+        } 
+        else if (LOGGER)
+        {
+            thread.logger.decayed_particles++;
+            thread.logger.burnt_particles++;
         }
 
-        performance_logger.print_counters(mpi_config->rank, mpi_config->world_size, runtime);
-    }
 
+        // Breakup changes the velocity, so the parent moves with its new velocity rather than its integrated path.
+        x1 = breakup ? x1 + v1 * delta : x1 + displacement;
+
+        particles.x1.set(p, x1);
+        particles.v1.set(p, v1);
+        particles.a1.set(p, state.a1);
+        particles.mass[p]     = mass;
+        particles.temp[p]     = temp;
+        particles.diameter[p] = diameter;
+        particles.age[p]      = age;
+        particles.decayed[p]  = decayed;
+    }
 
     template<class T> 
-    void ParticleSolver<T>::update_flow_field()
+    void ParticleSolver<T>::solve_spray_batched(uint64_t begin, uint64_t end, kernel_thread& thread)
     {
-        performance_logger.my_papi_start();
+        // One copy of the kernel per fuel property mode, so the loop has no per particle branch on the mode.
+        switch ( fuel_table.get_mode() )
+        {
+            case FUEL_PROPERTIES_LINEAR:  solve_spray_batched_kernel<FUEL_PROPERTIES_LINEAR>(begin, end, thread);  break;
+            case FUEL_PROPERTIES_CUBIC:   solve_spray_batched_kernel<FUEL_PROPERTIES_CUBIC>(begin, end, thread);   break;
+            default:                      solve_spray_batched_kernel<FUEL_PROPERTIES_EXACT>(begin, end, thread);   break;
+        }
+    }
 
-        active_blocks.clear();
+    template<class T> 
+    template<FUEL_PROPERTIES FUEL>
+    void ParticleSolver<T>::solve_spray_batched_kernel(uint64_t begin, uint64_t end, kernel_thread& thread)
+    {
+        // Same model as solve_spray, over columns [begin, end) so the loop vectorises. Breakup appends particles and draws random
+        // numbers, so here it is only flagged and breakup_particles applies it afterwards. Particles too stiff for one step are
+        // left unchanged and flagged for breakup_particles to sub-cycle. Scratch is the thread's, indexed from begin.
+        const uint64_t particles_size = end - begin;
+        if ( thread.breakup_scratch_size < particles_size )
+        {
+            thread.breakup_scratch_size = max(2 * thread.breakup_scratch_size, particles_size);
+            thread.breakup_mask         = (uint8_t *)realloc(thread.breakup_mask,    thread.breakup_scratch_size * sizeof(uint8_t));
+            thread.breakup_scratch      = (T *)      realloc(thread.breakup_scratch, thread.breakup_scratch_size * 4 * sizeof(T));
+        }
 
-        double avg_sent_cells  = 0.;
-        double non_zero_blocks = 0.;
+        T *__restrict x1_x         = particles.x1.x + begin;
+        T *__restrict x1_y         = particles.x1.y + begin;
+        T *__restrict x1_z         = particles.x1.z + begin;
+        T *__restrict v1_x         = particles.v1.x + begin;
+        T *__restrict v1_y         = particles.v1.y + begin;
+        T *__restrict v1_z         = particles.v1.z + begin;
+        T *__restrict a1_x         = particles.a1.x + begin;
+        T *__restrict a1_y         = particles.a1.y + begin;
+        T *__restrict a1_z         = particles.a1.z + begin;
+        T *__restrict mass_col     = particles.mass + begin;
+        T *__restrict temp_col     = particles.temp + begin;
+        T *__restrict diameter_col = particles.diameter + begin;
+        T *__restrict age_col      = particles.age + begin;
+        const T *__restrict weight_col = particles.weight + begin;
+        bool *__restrict decayed_col = particles.decayed + begin;
+
+        const T *__restrict gas_vel_x    = particles.gas_vel.x + begin;
+        const T *__restrict gas_vel_y    = particles.gas_vel.y + begin;
+        const T *__restrict gas_vel_z    = particles.gas_vel.z + begin;
+        const T *__restrict gas_pressure = particles.gas_pressure + begin;
+        const T *__restrict gas_temp     = particles.gas_temp + begin;
+
+        T *__restrict momentum_x = particles.momentum.x + begin;
+        T *__restrict momentum_y = particles.momentum.y + begin;
+        T *__restrict momentum_z = particles.momentum.z + begin;
+        T *__restrict energy_col = particles.energy + begin;
+        T *__restrict fuel_col   = particles.fuel + begin;
+
+        uint8_t *__restrict mask_col        = thread.breakup_mask;
+        T       *__restrict breakup_age_col = thread.breakup_scratch;
+        T       *__restrict rel_vel_x       = thread.breakup_scratch +     thread.breakup_scratch_size;
+        T       *__restrict rel_vel_y       = thread.breakup_scratch + 2 * thread.breakup_scratch_size;
+        T       *__restrict rel_vel_z       = thread.breakup_scratch + 3 * thread.breakup_scratch_size;
+
+        const T gas_density    = 6.9;                 // DUMMY VAL
+        const T omega          = 1.;                  // DUMMY_VAL
+        const T critical_temp  = FuelPropertyTable<T>::critical_temp;
+        const T molecular_ratio      = 29. / 108.;    // DUMMY_VAL
+        const T thermal_conduct_air  = 0.04418;       // DUMMY_VAL
+        const T specific_heat_air    = 1044.;         // DUMMY_VAL
+        const T weber_critical       = 0.5;
+        const T subcycle_limit       = ( subcycle_tolerance > 0. ) ? subcycle_tolerance : INFINITY;
+
+        const typename FuelPropertyTable<T>::lookup_view fuel_lookup = fuel_table.get_lookup_view();
+
+        #pragma omp simd
+        for (uint64_t p = 0; p < particles_size; p++)
+        {
+            const T v1x = v1_x[p], v1y = v1_y[p], v1z = v1_z[p];
+            const T a1x = a1_x[p], a1y = a1_y[p], a1z = a1_z[p];
+            const T temp     = temp_col[p];
+            const T mass     = mass_col[p];
+            const T diameter = diameter_col[p];
+            const T air_temp = gas_temp[p];
+
+            // SOLVE SPRAY/DRAG MODEL
+            const T rel_x = 0.65 * (gas_vel_x[p] - v1x);
+            const T rel_y = 0.65 * (gas_vel_y[p] - v1y);
+            const T rel_z = 0.65 * (gas_vel_z[p] - v1z);
+            const T relative_drop_vel_mag = fast_sqrt(rel_x * rel_x + rel_y * rel_y + rel_z * rel_z);
+
+            // Temperature dependent fuel properties, from the correlations or the fuel property table.
+            fuel_properties<T> fuel;
+            if constexpr ( FUEL == FUEL_PROPERTIES_EXACT )  fuel = FuelPropertyTable<T>::template exact<true>(temp);
+            else                                            fuel = fuel_lookup.template lookup<FUEL>(temp);
+            const T fuel_density = fuel.density;
+
+            const T kinematic_viscosity  = 1.48e-5 * fast_pow(air_temp, 1.5) / (air_temp + 110.4);
+            const T reynolds             = gas_density * relative_drop_vel_mag * diameter / kinematic_viscosity;
+            const T droplet_frontal_area = M_PI * (diameter / 2.) * (diameter / 2.);
+            const T drag_coefficient     = ( reynolds <= 1000. ) ? 24 * (1. + 0.15 * fast_pow(reynolds, 0.687))/reynolds : 0.424;
+
+            const T virtual_scale = -0.5 * gas_density * omega;
+            const T drag_scale    = drag_coefficient * reynolds  * 0.5 * gas_density * relative_drop_vel_mag *  droplet_frontal_area;
+
+            const T new_a1x = (virtual_scale * (a1x * delta) + drag_scale * rel_x) / mass;
+            const T new_a1y = (virtual_scale * (a1y * delta) + drag_scale * rel_y) / mass;
+            const T new_a1z = (virtual_scale * (a1z * delta) + drag_scale * rel_z) / mass;
+
+            // SOLVE EVAPORATION MODEL
+            const T fuel_vapour_pressure   = fuel.vapour_pressure;
+            const T pressure_relation      = (gas_pressure[p] + fuel_vapour_pressure) / fuel_vapour_pressure;
+            const T mass_fraction_fuel     = 1. / (1. + (pressure_relation - 1.) * molecular_ratio);
+            const T mass_fraction_fuel_ref = (2./3.) * mass_fraction_fuel;
+            const T mass_fraction_air_ref  = 1. - mass_fraction_fuel_ref;
+
+            const T thermal_conduct_fuel = fuel.thermal_conductivity;
+            const T thermal_conductivity = mass_fraction_air_ref * thermal_conduct_air + mass_fraction_fuel_ref * thermal_conduct_fuel;
+
+            const T specific_heat_fuel = fuel.specific_heat;
+            const T specific_heat      = mass_fraction_air_ref * specific_heat_air + mass_fraction_fuel_ref * specific_heat_fuel;
+
+            const T mass_transfer     = mass_fraction_fuel / (1. - mass_fraction_fuel);
+            const T log_mass_transfer = fast_log(1. + mass_transfer);
+            const T mass_delta        = 2. * M_PI * diameter * (thermal_conductivity / specific_heat_fuel) * log_mass_transfer;
+
+            const T latent_heat       = fuel.latent_heat;
+            const T air_heat_transfer = 2. * M_PI * fuel_vapour_pressure * (air_temp - temp) * log_mass_transfer / mass_transfer;
+            const T evaporation_heat  = mass_delta * latent_heat;
+            const T temp_delta        = (air_heat_transfer - evaporation_heat) / (specific_heat * mass);
+
+            const T evaporation_constant = 8. * log_mass_transfer * thermal_conductivity / (fuel_density * specific_heat_fuel);
+
+            // The stiffness test of spray_substep, multiplied through to avoid the divisions. Stiff particles take a zero length step
+            // here, which leaves them unchanged.
+            const bool stiff = (fast_max(0.65 * drag_scale, mass_delta) * delta > subcycle_limit * mass) |
+                               (evaporation_constant * delta > subcycle_limit * diameter * diameter)  |
+                               (fabs(temp_delta) * delta > subcycle_limit * temp);
+            const T step     = stiff ? 0. : delta;
+
+            const T new_v1x = v1x + new_a1x * step;
+            const T new_v1y = v1y + new_a1y * step;
+            const T new_v1z = v1z + new_a1z * step;
+
+            const T new_temp     = temp + temp_delta * step;
+            const T new_mass     = mass - mass_delta * step;
+            const T new_diameter = fast_sqrt(diameter * diameter  - evaporation_constant * step);
+
+            // Source terms for every droplet of the parcel.
+            const T weight = weight_col[p];
+            momentum_x[p] = weight * (new_mass * new_v1x * delta);
+            momentum_y[p] = weight * (new_mass * new_v1y * delta);
+            momentum_z[p] = weight * (new_mass * new_v1z * delta);
+            energy_col[p] = weight * ((air_heat_transfer - evaporation_heat) * delta);
+            fuel_col[p]   = weight * (mass_delta * delta);
+
+            const bool decayed = (new_mass < 0 || new_temp > critical_temp);
+
+            // SOLVE SPRAY BREAKUP MODEL (condition only)
+            const T age             = decayed ? age_col[p] : age_col[p] + step;
+            const T breakup_age     = fast_sqrt(fuel_density / (3*gas_density)) * (new_diameter / (2.0*relative_drop_vel_mag));
+            const T surface_tension = fuel_vapour_pressure * new_diameter / 4;
+            const T weber_droplet   = fuel_density * (relative_drop_vel_mag * relative_drop_vel_mag) * new_diameter / surface_tension;
+            const bool breakup      = !decayed && age > breakup_age && weber_droplet > weber_critical;
+
+            // Breakup changes the velocity, so those particles are moved in the post-pass.
+            const T move = breakup ? 0. : step;
+            x1_x[p] = x1_x[p] + new_v1x * move;
+            x1_y[p] = x1_y[p] + new_v1y * move;
+            x1_z[p] = x1_z[p] + new_v1z * move;
+
+            v1_x[p] = new_v1x;
+            v1_y[p] = new_v1y;
+            v1_z[p] = new_v1z;
+            a1_x[p] = stiff ? a1x : new_a1x;
+            a1_y[p] = stiff ? a1y : new_a1y;
+            a1_z[p] = stiff ? a1z : new_a1z;
+            mass_col[p]     = new_mass;
+            temp_col[p]     = new_temp;
+            diameter_col[p] = new_diameter;
+            age_col[p]      = age;
+            decayed_col[p]  = decayed;
+
+            mask_col[p]        = stiff ? SPRAY_SUBCYCLE : breakup;
+            breakup_age_col[p] = breakup_age;
+            rel_vel_x[p]       = rel_x;
+            rel_vel_y[p]       = rel_y;
+            rel_vel_z[p]       = rel_z;
+        }
+    }
 
-        for (uint64_t b = 0; b < mesh->num_blocks; b++)
+    template<class T> 
+    void ParticleSolver<T>::breakup_particles(uint64_t begin, uint64_t end, kernel_thread& thread)
+    {
+        // Scalar post-pass of solve_spray_batched. Draws are keyed on particle id, so they match solve_spray.
+        uint8_t *breakup_mask    = thread.breakup_mask;
+        T       *breakup_age_col = thread.breakup_scratch;
+        T       *rel_vel_x       = thread.breakup_scratch +     thread.breakup_scratch_size;
+        T       *rel_vel_y       = thread.breakup_scratch + 2 * thread.breakup_scratch_size;
+        T       *rel_vel_z       = thread.breakup_scratch + 3 * thread.breakup_scratch_size;
+
+        for (uint64_t p = begin; p < end; p++)
         {
-            cell_particle_field_map[b].erase(MESH_BOUNDARY);
-            uint64_t cell_size = cell_particle_field_map[b].size();
+            const uint64_t s = p - begin;
 
-            logger.sent_cells += cell_size;
-            avg_sent_cells    += cell_size;
-            non_zero_blocks   += cell_size > 0;
+            // The batched pass left stiff particles unchanged. Integrate them in sub-steps, then flag breakup as it would have.
+            if (breakup_mask[s] == SPRAY_SUBCYCLE)
+            {
+                particle_state_aos<T> state = particles.get_state(p);
+                const flow_aos<T> flow = { particles.gas_vel.get(p), particles.gas_pressure[p], particles.gas_temp[p] };
+
+                particle_aos<T> fields;
+                vec<T>          displacement;
+                const spray_step<T> step = integrate_spray(state, flow, fields, displacement, thread);
+
+                const T gas_density     = 6.9;  // DUMMY VAL
+                const bool decayed      = (state.mass < 0 || state.temp > FuelPropertyTable<T>::critical_temp);
+                const T breakup_age     = sqrt(step.fuel_density / (3*gas_density)) * (state.diameter / (2.0*step.relative_drop_vel_mag));
+                const T surface_tension = step.fuel_vapour_pressure * state.diameter / 4;
+                const T weber_droplet   = step.fuel_density * (step.relative_drop_vel_mag * step.relative_drop_vel_mag) * state.diameter / surface_tension;
+                state.age               = decayed ? state.age : state.age + delta;
+                const bool breakup      = !decayed && state.age > breakup_age && weber_droplet > 0.5;
+                state.x1                = breakup ? state.x1 : state.x1 + displacement;
+
+                particles.set_state(p, state);
+                particles.decayed[p] = decayed;
+                particles.momentum.set(p, state.weight * fields.momentum);
+                particles.energy[p]  = state.weight * fields.energy;
+                particles.fuel[p]    = state.weight * fields.fuel;
+
+                breakup_mask[s]    = breakup;
+                breakup_age_col[s] = breakup_age;
+                rel_vel_x[s]       = step.relative_drop_vel.x;
+                rel_vel_y[s]       = step.relative_drop_vel.y;
+                rel_vel_z[s]       = step.relative_drop_vel.z;
+            }
 
-            neighbours_size[b]   = cell_size;
-            
-            if ( cell_size )
+            if (particles.decayed[p])
             {
-                active_blocks.push_back(b);
-                if (statuses.size() < active_blocks.size())
+                if (LOGGER)
                 {
-                    MPI_Status mpi_status = { 0, 0, 0, 0, 0};
-                    statuses.push_back( mpi_status );
-
-                    send_requests.push_back( MPI_REQUEST_NULL );
-                    send_requests.push_back( MPI_REQUEST_NULL );
-                    recv_requests.push_back( MPI_REQUEST_NULL );
-                    recv_requests.push_back( MPI_REQUEST_NULL );
+                    thread.logger.decayed_particles++;
+                    thread.logger.burnt_particles++;
                 }
+                continue;
             }
-        }
-        avg_sent_cells              /= non_zero_blocks;
-        logger.sent_cells_per_block += avg_sent_cells;
 
-        // MPI_Barrier(mpi_config->world);
+            if (LOGGER)  thread.logger.breakup_age = breakup_age_col[s];
 
+            if (!breakup_mask[s])  continue;
 
-        if ( PARTICLE_SOLVER_DEBUG && mpi_config->rank == mpi_config->particle_flow_rank )  printf("\tRank %d: Running fn: update_flow_field.\n", mpi_config->rank);
-        if ( PARTICLE_SOLVER_DEBUG && mpi_config->rank == mpi_config->particle_flow_rank )  printf("\tRank %d: Sending index sizes.\n", mpi_config->rank);
+            const T diameter    = particles.diameter[p];
+            const T mass        = particles.mass[p];
+            const T breakup_age = breakup_age_col[s];
+            const vec<T> relative_drop_vel = { rel_vel_x[s], rel_vel_y[s], rel_vel_z[s] };
+            vec<T> v1 = particles.v1.get(p);
 
-        uint64_t count = 0;
-        for (uint64_t b : active_blocks)
-        {
-            neighbours_size[b] = cell_particle_field_map[b].size();
-            if ( PARTICLE_SOLVER_DEBUG && mpi_config->rank == mpi_config->particle_flow_rank )  printf("\tRank %d: Sending %d indexes to block %lu.\n", mpi_config->rank, neighbours_size[b], b);
+            random_stream rng = { particle_dist->seed, STREAM_BREAKUP, particles.id[p], timestep_count };
+            const T rand_prop = 0.1 + rng.uniform() * (0.9 - 0.1);
+            const T diameter1 = rand_prop * diameter;
+            const T diameter2 = diameter - diameter1;
 
-            // MPI_Isend(&neighbours_size[b],      1,                  MPI_INT,                             mpi_config->particle_flow_world_size + b, 0, mpi_config->world, &send_requests[count] );
-            MPI_Issend(cell_particle_indexes[b], neighbours_size[b], MPI_UINT64_T,                        mpi_config->particle_flow_world_size + b, 0, mpi_config->world, &send_requests[count  + 0*active_blocks.size()] );
-            MPI_Isend(cell_particle_aos[b],     neighbours_size[b], mpi_config->MPI_PARTICLE_STRUCTURE,  mpi_config->particle_flow_world_size + b, 2, mpi_config->world, &send_requests[count++ + 1*active_blocks.size()] );
-        }
+            const T droplet1_ratio = diameter1 / diameter;
 
+            const T mass1 = droplet1_ratio * mass;
+            const T mass2 = mass - mass1;
 
-        MPI_Waitall(active_blocks.size(), send_requests.data(), MPI_STATUSES_IGNORE);
+            const T length = diameter / (2.0 * breakup_age);
 
-        if ( PARTICLE_SOLVER_DEBUG && mpi_config->rank == mpi_config->particle_flow_rank )  printf("\tRank %d: Wait has returned successfully\n", mpi_config->rank);
-        MPI_Barrier(mpi_config->particle_flow_world);
+            vec<T> velocity1 = rng.uniform_vec();
+            vec<T> velocity2 = rng.uniform_vec();
 
-        int sends_done = 1;
-        if ( PARTICLE_SOLVER_DEBUG && mpi_config->rank == mpi_config->particle_flow_rank )  printf("\tRank %d: All index sizes sent.\n", mpi_config->rank);
-        
-        MPI_Ibcast(&sends_done, 1, MPI_INT, 0, mpi_config->world, &bcast_request);
+            velocity1 = -1. + (velocity1 * 2.);
+            velocity2 = -1. + (velocity2 * 2.);
 
-        for (uint64_t b : active_blocks)
-            cell_particle_field_map[b].clear();
+            vec<T> unit_rel_velocity = relative_drop_vel / magnitude(relative_drop_vel);
 
-        uint64_t posted_recvs = 0;
-        uint64_t ba = active_blocks.size() - 1;
-        uint64_t bi;
-        bool     all_processed      = true;
-        bool    *posted_block_recvs = async_locks;
-        bool    *processed_block    = async_locks + active_blocks.size();
-        for ( uint64_t ba = 0; ba < active_blocks.size(); ba++ )  
-        {
-            posted_block_recvs[ba]  = false;
-            processed_block[ba]     = false;
-            all_processed       &= processed_block[ba];
-        }
-        
-        while (!all_processed)
-        {
-            ba = (ba + 1) % active_blocks.size();
-            bi = active_blocks[ba];
+            velocity1 = velocity1 - dot_product(velocity1, unit_rel_velocity) * unit_rel_velocity; 
+            velocity2 = velocity2 - dot_product(velocity2, unit_rel_velocity) * unit_rel_velocity; 
 
-            int message_waiting = 0;
-            MPI_Iprobe (MPI_ANY_SOURCE, 0, mpi_config->world, &message_waiting, &statuses[posted_recvs] );
+            const vec<T> x1 = particles.x1.get(p);
+            thread.breakup_children.push_back(Particle<T>(x1 + (velocity2 * length + v1 * delta), velocity2 * length + v1, particles.a1.get(p), mass2, particles.temp[p], diameter2, particles.cell[p], rng.bits() | (1ULL << 63), particles.weight[p]));
 
-            if ( message_waiting && (posted_recvs < active_blocks.size()) )
+            // Update parent to droplet1, then apply the position update the batched pass skipped.
+            v1 += velocity1 * length;
+            particles.v1.set(p, v1);
+            particles.x1.set(p, x1 + v1 * delta);
+            particles.mass[p] = mass1;
+            particles.age[p]  = 0.0;
+
+            if (LOGGER)
             {
-                const uint64_t send_rank = statuses[posted_recvs].MPI_SOURCE;
-                const uint64_t block_id  = statuses[posted_recvs].MPI_SOURCE - mpi_config->particle_flow_world_size;
+                thread.logger.breakups++;
+                thread.logger.num_particles++;
+            }
+        }
+    }
 
-                MPI_Get_count( &statuses[posted_recvs], MPI_UINT64_T, &neighbours_size[block_id] );
-                resize_nodes_arrays(neighbours_size[block_id] + 1, block_id);
+    template<class T> 
+    void ParticleSolver<T>::append_breakup_children()
+    {
+        // Children are staged while the spray kernels run, so the store never grows under a kernel iterating over it.
+        for (auto& thread : kernel_threads)
+        {
+            particles.append(thread.breakup_children.data(), thread.breakup_children.size());
+            thread.breakup_children.clear();
+        }
+    }
 
-                logger.nodes_recieved += neighbours_size[block_id];
-                int active_block_index = find(active_blocks.begin(), active_blocks.end(), block_id) - active_blocks.begin(); 
+    template<class T> 
+    void ParticleSolver<T>::merge_kernel_threads()
+    {
+        // Deposits each thread's source terms and adds its counters to the solver's, in thread order.
+        for (auto& thread : kernel_threads)
+        {
+            for (auto& cell_fields : thread.cell_fields)
+                add_cell_particle_fields(cell_fields.first, cell_fields.second);
+            thread.cell_fields.clear();
+
+            logger.num_particles          += thread.logger.num_particles;
+            logger.cell_checks            += thread.logger.cell_checks;
+            logger.lost_particles         += thread.logger.lost_particles;
+            logger.boundary_intersections += thread.logger.boundary_intersections;
+            logger.decayed_particles      += thread.logger.decayed_particles;
+            logger.breakups               += thread.logger.breakups;
+            logger.burnt_particles        += thread.logger.burnt_particles;
+            logger.subcycled_particles    += thread.logger.subcycled_particles;
+            logger.spray_substeps         += thread.logger.spray_substeps;
+            logger.max_spray_substeps      = max(logger.max_spray_substeps, thread.logger.max_spray_substeps);
+            if ( thread.logger.breakup_age != 0. )  logger.breakup_age = thread.logger.breakup_age;
+
+            memset(&thread.logger, 0, sizeof(Particle_Logger));
+        }
+    }
 
-                if ( PARTICLE_SOLVER_DEBUG )  printf("\tRank %d: Posted %d recieves (ptr %p) for flow block %lu (slots %d %ld max %ld) .\n", mpi_config->rank, neighbours_size[block_id], all_interp_node_indexes[block_id], block_id, active_block_index, active_block_index + active_blocks.size(), recv_requests.size() );
-                MPI_Irecv ( all_interp_node_indexes[block_id],     neighbours_size[block_id], MPI_UINT64_T,                   send_rank, 0, mpi_config->world, &recv_requests[active_block_index] );
-                MPI_Irecv ( all_interp_node_flow_fields[block_id], neighbours_size[block_id], mpi_config->MPI_FLOW_STRUCTURE, send_rank, 1, mpi_config->world, &recv_requests[active_block_index + active_blocks.size()] );
+    template<class T> 
+    void ParticleSolver<T>::interpolate_particles(uint64_t begin, uint64_t end)
+    {
+        // Interpolate flow values from the cell's nodes to particles [begin, end). Runs on the kernel threads, so the node cache
+        // is only read with find, which never inserts or rehashes. Every node was cached before the kernel started.
+        const uint64_t cell_size = mesh->cell_size; 
 
-                posted_block_recvs[active_block_index] = true;
-                posted_recvs++;
-                continue;
-            }
+        if ( interpolation == INTERPOLATE_TRILINEAR )
+        {
+            #pragma ivdep
+            for (uint64_t p = begin; p < end; p++)
+            {
+                if (PARTICLE_SOLVER_DEBUG && (particles.cell[p] >= mesh->mesh_size))
+                    {printf("ERROR::: RANK %d Cell %lu out of range\n", mpi_config->rank, particles.cell[p]); exit(1);}
 
-            int recieve_done = 0;
-            MPI_Test(&recv_requests[ba], &recieve_done, MPI_STATUS_IGNORE);
+                const uint64_t  block_id   = mesh->get_block_id(particles.cell[p]);
+                const uint64_t *cell_nodes = &mesh->cells[(particles.cell[p] - mesh->shmem_cell_disp) * cell_size];
 
-            if ( recieve_done && !processed_block[ba] && posted_block_recvs[ba] )
-            {
-                // uint64_t size_before = node_to_field_address_map.size();
+                // Position within the cell, from 0 at vertex A to 1 at vertex H. Vertex n is at corner (n & 1, (n >> 1) & 1, n >> 2).
+                const vec<T>& low  = mesh->points[cell_nodes[A_VERTEX] - mesh->shmem_point_disp];
+                const vec<T>& high = mesh->points[cell_nodes[H_VERTEX] - mesh->shmem_point_disp];
+                const vec<T>  local = (particles.x1.get(p) - low) / (high - low);
 
-                // if ( PARTICLE_SOLVER_DEBUG )  
-                // {
-                //     printf("\tRank %d: Indexes (%p ptr) load finished for flow block %lu (slots %lu ) .\n", mpi_config->rank, all_interp_node_indexes[bi], bi, ba );
+                const T lx[2] = { 1. - min(max(local.x, 0.), 1.), min(max(local.x, 0.), 1.) };
+                const T ly[2] = { 1. - min(max(local.y, 0.), 1.), min(max(local.y, 0.), 1.) };
+                const T lz[2] = { 1. - min(max(local.z, 0.), 1.), min(max(local.z, 0.), 1.) };
 
-                //     if      ( (uint64_t) neighbours_size[bi]  >= (node_flow_array_sizes[bi]   / sizeof(flow_aos<T>)) )
-                //         {printf("ERROR RECV VALS : Rank %d Block %lu will write indexes to unallocated memory required size %d max %lu\n", mpi_config->rank, bi, neighbours_size[bi], node_flow_array_sizes[bi] / sizeof(flow_aos<T>)); exit(1);}
-                //     else if ( (uint64_t) neighbours_size[bi]  >= (node_index_array_sizes[bi]  / sizeof(uint64_t)) )
-                //         {printf("ERROR RECV VALS : Rank %d Block %lu will write fields  to unallocated memory required size %d max %lu\n", mpi_config->rank, bi, neighbours_size[bi], node_index_array_sizes[bi] / sizeof(uint64_t)); exit(1);}
-                // }
+                vec<T> interp_gas_vel = {0.0, 0.0, 0.0};
+                T interp_gas_pre      = 0.0;
+                T interp_gas_tem      = 0.0;
 
                 #pragma ivdep
-                for (int i = 0; i < neighbours_size[bi]; i++)
+                for (uint64_t n = 0; n < 8; n++)
                 {
-                    node_to_field_address_map[all_interp_node_indexes[bi][i]] = &all_interp_node_flow_fields[bi][i];
+                    const flow_cache_aos<T> *cached_node = node_flow_cache[block_id].find(cell_nodes[n]);
+                    if (PARTICLE_SOLVER_DEBUG && (cached_node == nullptr))
+                        {printf("Rank %d Block %lu cell %lu node %lu missing from node cache (size %lu)\n", mpi_config->rank, block_id, particles.cell[p], cell_nodes[n], node_flow_cache[block_id].size() ); exit(1);};
 
-                    // if (PARTICLE_SOLVER_DEBUG && all_interp_node_indexes[bi][i] > mesh->points_size )
-                    //     {printf("ERROR RECV VALS : Rank %d Flow block %lu Value %lu out of range at %d\n", mpi_config->rank, bi, all_interp_node_indexes[bi][i], i); exit(1);}
+                    const flow_aos<T>& node_flow = cached_node->flow;
+                    const T            weight    = lx[n & 1] * ly[(n >> 1) & 1] * lz[n >> 2];
+
+                    interp_gas_vel += weight * node_flow.vel;
+                    interp_gas_pre += weight * node_flow.pressure;
+                    interp_gas_tem += weight * node_flow.temp;
                 }
 
-                // if (PARTICLE_SOLVER_DEBUG && size_before != node_to_field_address_map.size())
-                //     {printf("\tRank %d: Recieving wrong amount of data(+%lu). Block %lu Node map size %ld sent size %d.\n", mpi_config->rank, node_to_field_address_map.size() - size_before, bi, node_to_field_address_map.size(), neighbours_size[bi] ); exit(1);};
-                    
-                processed_block[ba] = true;
+                // The weights sum to one, so no normalisation is needed.
+                particles.gas_vel.set(p, interp_gas_vel);
+                particles.gas_pressure[p] = interp_gas_pre;
+                particles.gas_temp[p]     = interp_gas_tem;
             }
-
-            all_processed = true;
-            for (uint64_t b = 0; b < active_blocks.size(); b++ )  all_processed &= processed_block[b];
         }
+        else
+        {
+            #pragma ivdep
+            for (uint64_t p = begin; p < end; p++)
+            {
+                vec<T> total_vector_weight   = {0.0, 0.0, 0.0};
+                T total_scalar_weight        = 0.0;
 
-        MPI_Waitall( recv_requests.size(), recv_requests.data(), MPI_STATUSES_IGNORE);
-
-        logger.useful_nodes_proportion += node_to_field_address_map.size();
-        
-        // MPI_Barrier(mpi_config->world);
-        if ( PARTICLE_SOLVER_DEBUG && mpi_config->rank == mpi_config->particle_flow_rank )  printf("\tRank %d: Completed comms.\n", mpi_config->rank);
-        
+                vec<T> interp_gas_vel = {0.0, 0.0, 0.0};
+                T interp_gas_pre      = 0.0;
+                T interp_gas_tem      = 0.0;
 
-        performance_logger.my_papi_stop(performance_logger.update_flow_field_event_counts, &performance_logger.update_flow_field_time);
-    }
-            
-    template<class T> 
-    void ParticleSolver<T>::particle_release()
-    {
-        performance_logger.my_papi_start();
+                const vec<T> particle_position = particles.x1.get(p);
 
-        // TODO: Reuse decaying particle space
-        if (PARTICLE_SOLVER_DEBUG && mpi_config->rank == mpi_config->particle_flow_rank )  printf("\tRank %d: Running fn: particle_release.\n", mpi_config->rank);
-        function<void(uint64_t *, uint64_t ***, particle_aos<T> ***)> resize_cell_particles_fn = [this] (uint64_t *elements, uint64_t ***indexes, particle_aos<T> ***cell_particle_fields) { return resize_cell_particle(elements, indexes, cell_particle_fields); };
+                if (PARTICLE_SOLVER_DEBUG && (particles.cell[p] >= mesh->mesh_size))
+                    {printf("ERROR::: RANK %d Cell %lu out of range\n", mpi_config->rank, particles.cell[p]); exit(1);}
 
-        particle_dist->emit_particles_evenly(particles, cell_particle_field_map, node_to_field_address_map, cell_particle_indexes, cell_particle_aos, resize_cell_particles_fn, &logger);
-        // particle_dist->emit_particles_waves(particles, cell_particle_field_map, cell_particle_indexes, cell_particle_aos,  &logger);
+                const uint64_t block_id = mesh->get_block_id(particles.cell[p]);
 
-        performance_logger.my_papi_stop(performance_logger.emit_event_counts, &performance_logger.emit_time);
-    }
+                #pragma ivdep
+                for (uint64_t n = 0; n < cell_size; n++)
+                {
+                    uint64_t node = mesh->cells[(particles.cell[p] - mesh->shmem_cell_disp) * cell_size + n];
 
-    template<class T> 
-    void ParticleSolver<T>::solve_spray_equations()
-    {
-        if (PARTICLE_SOLVER_DEBUG && mpi_config->rank == mpi_config->particle_flow_rank )  printf("\tRank %d: Running fn: solve_spray_equations.\n", mpi_config->rank);
 
-        const uint64_t cell_size       = mesh->cell_size; 
-        const uint64_t particles_size  = particles.size(); 
+                    if (PARTICLE_SOLVER_DEBUG && (node >= mesh->points_size))
+                        {printf("ERROR::: RANK %d Node %lu out of range\n", mpi_config->rank, node); exit(1);}
+                    const flow_cache_aos<T> *cached_node = node_flow_cache[block_id].find(node);
+                    if (PARTICLE_SOLVER_DEBUG && (cached_node == nullptr))
+                        {printf("Rank %d Block %lu cell %lu node %lu missing from node cache (size %lu)\n", mpi_config->rank, block_id, particles.cell[p], node, node_flow_cache[block_id].size() ); exit(1);};
 
-        performance_logger.my_papi_start();
+                    const flow_aos<T>& node_flow = cached_node->flow;
 
-        // Solve spray equations
-        #pragma ivdep
-        for (uint64_t p = 0; p < particles_size; p++)
-        {
-            vec<T> total_vector_weight   = {0.0, 0.0, 0.0};
-            T total_scalar_weight        = 0.0;
 
-            vec<T> interp_gas_vel = {0.0, 0.0, 0.0};
-            T interp_gas_pre      = 0.0;
-            T interp_gas_tem      = 0.0;
-            
+                    const vec<T> node_to_particle = particle_position - mesh->points[node - mesh->shmem_point_disp];
 
-            #pragma ivdep
-            for (uint64_t n = 0; n < cell_size; n++)
-            {
-                if (PARTICLE_SOLVER_DEBUG && (particles[p].cell >= mesh->mesh_size))
-                    {printf("ERROR::: RANK %d Cell %lu out of range\n", mpi_config->rank, particles[p].cell); exit(1);}
-                
-                uint64_t node = mesh->cells[(particles[p].cell - mesh->shmem_cell_disp) * cell_size + n];
-                const uint64_t block_id = mesh->get_block_id(particles[p].cell);
+                    vec<T> weight      = 1.0 / ((node_to_particle * node_to_particle) + vec<T> {__DBL_MIN__, __DBL_MIN__, __DBL_MIN__});
+                    T weight_magnitude = magnitude(weight);
 
+                    total_vector_weight   += weight;
+                    total_scalar_weight   += weight_magnitude;
 
-                if (PARTICLE_SOLVER_DEBUG && (node >= mesh->points_size))
-                    {printf("ERROR::: RANK %d Node %lu out of range\n", mpi_config->rank, node); exit(1);}
-                if (PARTICLE_SOLVER_DEBUG && (node_to_field_address_map[node] < (flow_aos<T> *)5))
-                    {printf("Rank %d Block %lu cell %lu node %lu flow_pointer %p block_flow_pointer %p size %lu\n", mpi_config->rank, block_id, particles[p].cell, node, node_to_field_address_map[node], all_interp_node_flow_fields[block_id], node_flow_array_sizes[block_id] ); exit(1);};
+                    // if (PARTICLE_SOLVER_DEBUG) check_flow_field_exit ( "SOLVE SPRAY: Node value", &node_flow, &mesh->dummy_flow_field, node );
 
+                    interp_gas_vel        += weight           * node_flow.vel;
+                    interp_gas_pre        += weight_magnitude * node_flow.pressure;
+                    interp_gas_tem        += weight_magnitude * node_flow.temp;
+                }
 
-                const vec<T> node_to_particle = particles[p].x1 - mesh->points[node - mesh->shmem_point_disp];
+                particles.gas_vel.set(p, interp_gas_vel / total_vector_weight);
+                particles.gas_pressure[p] = interp_gas_pre / total_scalar_weight;
+                particles.gas_temp[p]     = interp_gas_tem / total_scalar_weight;
+            }
+        }
+    }
 
-                vec<T> weight      = 1.0 / ((node_to_particle * node_to_particle) + vec<T> {__DBL_MIN__, __DBL_MIN__, __DBL_MIN__});
-                T weight_magnitude = magnitude(weight);
+    template<class T> 
+    void ParticleSolver<T>::locate_particles(uint64_t begin, uint64_t end, kernel_thread& thread)
+    {
+        // Moves particles [begin, end) to the cell containing their new position and deposits their source terms in the thread's
+        // cell fields, which merge_kernel_threads adds to the cells sent to the flow solver.
+        for (uint64_t p = begin; p < end; p++)
+        {   
+            if (!particles.decayed[p])
+                Particle<T>::locate_cell(mesh, particles.x1.get(p), particles.cell[p], particles.decayed[p], &thread.logger);
 
-                total_vector_weight   += weight;
-                total_scalar_weight   += weight_magnitude;
+            if (!particles.decayed[p])
+            {
+                const uint64_t cell     = particles.cell[p];
 
-                // if (PARTICLE_SOLVER_DEBUG) check_flow_field_exit ( "SOLVE SPRAY: Node value", node_to_field_address_map[node], &mesh->dummy_flow_field, node );
+                // Particles which left this rank's region are accumulated by their new owner after migration.
+                if ( decompose_particles && block_owners[mesh->get_block_id(cell)] != mpi_config->particle_flow_rank )  continue;
 
-                interp_gas_vel        += weight           * node_to_field_address_map[node]->vel;
-                interp_gas_pre        += weight_magnitude * node_to_field_address_map[node]->pressure;
-                interp_gas_tem        += weight_magnitude * node_to_field_address_map[node]->temp;
+                particle_aos<T>& cell_fields = thread.cell_fields[cell];
+                cell_fields.momentum += particles.momentum.get(p);
+                cell_fields.energy   += particles.energy[p];
+                cell_fields.fuel     += particles.fuel[p];
             }
+        }
+    }
+
+    template<class T> 
+    void ParticleSolver<T>::solve_spray_equations()
+    {
+        if (PARTICLE_SOLVER_DEBUG && mpi_config->rank == mpi_config->particle_flow_rank )  printf("\tRank %d: Running fn: solve_spray_equations.\n", mpi_config->rank);
+
+        const uint64_t particles_size  = particles.size(); 
+        const uint64_t chunks          = (particles_size + FUSED_KERNEL_CHUNK - 1) / FUSED_KERNEL_CHUNK;
 
-            particles[p].local_flow_value.vel           = interp_gas_vel / total_vector_weight;
-            particles[p].local_flow_value.pressure      = interp_gas_pre / total_scalar_weight;
-            particles[p].local_flow_value.temp          = interp_gas_tem / total_scalar_weight;
+        performance_logger.my_papi_start();
 
-            // if (PARTICLE_SOLVER_DEBUG) check_flow_field_exit ( "SOLVE SPRAY: Interpolated particle value ", &particles[p].local_flow_value, &mesh->dummy_flow_field, p );
-        }
+        #pragma omp parallel for schedule(static) num_threads(particle_threads)
+        for (uint64_t chunk = 0; chunk < chunks; chunk++)
+            interpolate_particles(chunk * FUSED_KERNEL_CHUNK, min((chunk + 1) * FUSED_KERNEL_CHUNK, particles_size));
 
         if (PARTICLE_SOLVER_DEBUG && mpi_config->rank == mpi_config->particle_flow_rank )  printf("\tRank %d: Finished interpolation. Starting spray computation.\n", mpi_config->rank);
 
-        node_to_field_address_map.clear(); // TODO move this? 
-
-        // static uint64_t node_avg = 0;
-        static uint64_t timestep_counter = 0;
-        timestep_counter++;
+        requested_nodes.clear(); // TODO move this? 
 
         performance_logger.my_papi_stop(performance_logger.particle_interpolation_event_counts, &performance_logger.particle_interpolation_time);
         performance_logger.my_papi_start();
 
-        vector<uint64_t> decayed_particles;
-        #pragma ivdep
-        for (uint64_t p = 0; p < particles_size; p++)
+        #pragma omp parallel for schedule(static) num_threads(particle_threads)
+        for (uint64_t chunk = 0; chunk < chunks; chunk++)
         {
-            particles[p].solve_spray( delta, &logger, particles );
+            kernel_thread& thread = get_kernel_thread();
+            const uint64_t begin  = chunk * FUSED_KERNEL_CHUNK;
+            const uint64_t end    = min(begin + FUSED_KERNEL_CHUNK, particles_size);
 
-            if (particles[p].decayed)  decayed_particles.push_back(p);
+            if (BATCHED_SPRAY)
+            {
+                solve_spray_batched( begin, end, thread );
+                breakup_particles( begin, end, thread );
+            }
+            else
+            {
+                for (uint64_t p = begin; p < end; p++)
+                    solve_spray( p, thread );
+            }
         }
 
-        const uint64_t decayed_particles_size = decayed_particles.size();
-        #pragma ivdep
-        for (int128_t i = decayed_particles_size - 1; i >= 0; i--)
-        {
-            particles[decayed_particles[i]] = particles.back();
-            particles.pop_back();
-        }
+        append_breakup_children();
+        merge_kernel_threads();
+
+        particles.remove_decayed();
 
         performance_logger.my_papi_stop(performance_logger.spray_kernel_event_counts, &performance_logger.spray_time);
     }
@@ -376,73 +2196,70 @@ namespace minicombust::particles
         performance_logger.my_papi_start();
 
         if (PARTICLE_SOLVER_DEBUG && mpi_config->rank == mpi_config->particle_flow_rank )  printf("\tRank %d: Running fn: update_particle_positions.\n", mpi_config->rank);
-        const uint64_t particles_size  = particles.size();
-
-        uint64_t elements [mesh->num_blocks];
-        for (uint64_t i = 0; i < mesh->num_blocks; i++)
-            elements[i] = 0;
 
-        // Update particle positions
-        vector<uint64_t> decayed_particles;
-        #pragma ivdep
-        for (uint64_t p = 0; p < particles_size; p++)
-        {   
-            // Check if particle is in the current cell. Tetras = Volume/Area comparison method. https://www.peertechzpublications.com/articles/TCSIT-6-132.php.
-            particles[p].update_cell(mesh, &logger);
+        const uint64_t particles_size = particles.size(); 
+        const uint64_t chunks         = (particles_size + FUSED_KERNEL_CHUNK - 1) / FUSED_KERNEL_CHUNK;
 
-            if (particles[p].decayed)  decayed_particles.push_back(p);
-            else
-            {
-                const uint64_t cell     = particles[p].cell;
-                const uint64_t block_id = mesh->get_block_id(particles[p].cell);
+        #pragma omp parallel for schedule(static) num_threads(particle_threads)
+        for (uint64_t chunk = 0; chunk < chunks; chunk++)
+            locate_particles(chunk * FUSED_KERNEL_CHUNK, min((chunk + 1) * FUSED_KERNEL_CHUNK, particles_size), get_kernel_thread());
 
-                if ( cell_particle_field_map[block_id].count(cell) ) 
-                {
-                    const uint64_t index = cell_particle_field_map[block_id][cell];
+        merge_kernel_threads();
 
-                    cell_particle_aos[block_id][index].momentum += particles[p].particle_cell_fields.momentum;
-                    cell_particle_aos[block_id][index].energy   += particles[p].particle_cell_fields.energy;
-                    cell_particle_aos[block_id][index].fuel     += particles[p].particle_cell_fields.fuel;
-                }
-                else
-                {
+        particles.remove_decayed();
 
-                    const uint64_t index = cell_particle_field_map[block_id].size();
-                    elements[block_id]   = cell_particle_field_map[block_id].size() + 1;
+        performance_logger.my_papi_stop(performance_logger.position_kernel_event_counts, &performance_logger.position_time);
+    }
 
-                    resize_cell_particle(elements, NULL, NULL);
+    template<class T> 
+    void ParticleSolver<T>::solve_particles_fused()
+    {
+        // solve_spray_equations and update_particle_positions in one pass. Each chunk of FUSED_KERNEL_CHUNK particles is
+        // interpolated, integrated, located and deposited while its columns are still in cache, and decayed particles are
+        // compacted once at the end instead of after each kernel. Chunks are split between particle_threads threads.
+        if (PARTICLE_SOLVER_DEBUG && mpi_config->rank == mpi_config->particle_flow_rank )  printf("\tRank %d: Running fn: solve_particles_fused.\n", mpi_config->rank);
 
-                    cell_particle_indexes[block_id][index]   = cell;
-                    cell_particle_aos[block_id][index]       = particles[p].particle_cell_fields;
+        performance_logger.my_papi_start();
 
-                    cell_particle_field_map[block_id][cell]  = index;
+        // Node requests for the next timestep are made as particles are deposited.
+        requested_nodes.clear();
 
+        const uint64_t particles_size = particles.size(); 
+        const uint64_t chunks         = (particles_size + FUSED_KERNEL_CHUNK - 1) / FUSED_KERNEL_CHUNK;
 
-                    #pragma ivdep
-                    for (uint64_t n = 0; n < mesh->cell_size; n++)
-                    {
-                        const uint64_t node_id = mesh->cells[(cell - mesh->shmem_cell_disp) * mesh->cell_size + n];
+        #pragma omp parallel for schedule(static) num_threads(particle_threads)
+        for (uint64_t chunk = 0; chunk < chunks; chunk++)
+        {
+            kernel_thread& thread = get_kernel_thread();
+            const uint64_t begin  = chunk * FUSED_KERNEL_CHUNK;
+            const uint64_t end    = min(begin + FUSED_KERNEL_CHUNK, particles_size);
 
-                        if (!node_to_field_address_map.count(node_id))
-                        {
-                            node_to_field_address_map[node_id] = (flow_aos<T> *)2;
-                        }
-                    }
+            interpolate_particles(begin, end);
 
-                }
+            if (BATCHED_SPRAY)
+            {
+                solve_spray_batched( begin, end, thread );
+                breakup_particles( begin, end, thread );
+            }
+            else
+            {
+                for (uint64_t p = begin; p < end; p++)
+                    solve_spray( p, thread );
             }
 
+            locate_particles(begin, end, thread);
         }
 
-        const uint64_t decayed_particles_size = decayed_particles.size();
-        #pragma ivdep
-        for (int128_t i = decayed_particles_size - 1; i >= 0; i--)
-        {
-            particles[decayed_particles[i]] = particles.back();
-            particles.pop_back();
-        }
+        // Breakup children are appended after the last chunk. As in the unfused kernels, they are located but not integrated
+        // until the next timestep.
+        append_breakup_children();
+        locate_particles(particles_size, particles.size(), kernel_threads[0]);
 
-        performance_logger.my_papi_stop(performance_logger.position_kernel_event_counts, &performance_logger.position_time);
+        merge_kernel_threads();
+
+        particles.remove_decayed();
+
+        performance_logger.my_papi_stop(performance_logger.fused_kernel_event_counts, &performance_logger.fused_kernel_time);
     }
 
     template<class T>
@@ -470,14 +2287,13 @@ namespace minicombust::particles
     template<class T> 
     void ParticleSolver<T>::timestep()
     {
-        static int count = 0;
         const int  comms_timestep = 1;
 
         if (PARTICLE_SOLVER_DEBUG && mpi_config->rank == mpi_config->particle_flow_rank )  printf("Rank %d: Start particle timestep\n", mpi_config->rank);
-        if ( (count % 100) == 0 )
+        if ( (timestep_count % 100) == 0 )
         {
             uint64_t particles_in_simulation = particles.size();
-            uint64_t total_particles_in_simulation;
+            uint64_t total_particles_in_simulation, max_particles_in_simulation, min_particles_in_simulation;
 
             double arr_usage  = ((double)get_array_memory_usage())   / 1.e9;
             double stl_usage  = ((double)get_stl_memory_usage())     / 1.e9 ;
@@ -486,6 +2302,8 @@ namespace minicombust::particles
 
 
             MPI_Reduce(&particles_in_simulation, &total_particles_in_simulation, 1, MPI_UINT64_T, MPI_SUM, 0, mpi_config->particle_flow_world);
+            MPI_Reduce(&particles_in_simulation, &max_particles_in_simulation,   1, MPI_UINT64_T, MPI_MAX, 0, mpi_config->particle_flow_world);
+            MPI_Reduce(&particles_in_simulation, &min_particles_in_simulation,   1, MPI_UINT64_T, MPI_MIN, 0, mpi_config->particle_flow_world);
             MPI_Reduce(&arr_usage,               &arr_usage_total,               1, MPI_DOUBLE,   MPI_SUM, 0, mpi_config->particle_flow_world);
             MPI_Reduce(&stl_usage,               &stl_usage_total,               1, MPI_DOUBLE,   MPI_SUM, 0, mpi_config->particle_flow_world);
             MPI_Reduce(&mesh_usage,              &mesh_usage_total,              1, MPI_DOUBLE,   MPI_SUM, 0, mpi_config->particle_flow_world);
@@ -496,25 +2314,50 @@ namespace minicombust::particles
                 // printf("Timestep %6d Particle array mem (TOTAL %8.3f GB) (AVG %8.3f GB) STL mem (TOTAL %8.3f GB) (AVG %8.3f GB) Particles (TOTAL %lu) (AVG %lu) \n", count, arr_usage_total,               arr_usage_total               / mpi_config->particle_flow_world_size, 
                 //                                                                                                                                                             stl_usage_total,               stl_usage_total               / mpi_config->particle_flow_world_size, 
                 //                                                                                                                                                             total_particles_in_simulation, total_particles_in_simulation / mpi_config->particle_flow_world_size);
-                printf("Timestep %6d Particle mem (TOTAL %8.3f GB) (AVG %8.3f GB) Particles (TOTAL %lu) (AVG %lu) \n", count, (arr_usage_total + stl_usage_total + mesh_usage_total), (arr_usage_total + stl_usage_total + mesh_usage_total) / mpi_config->particle_flow_world_size, 
-                                                                                                                              total_particles_in_simulation,                           total_particles_in_simulation                         / mpi_config->particle_flow_world_size);
+                printf("Timestep %6lu Particle mem (TOTAL %8.3f GB) (AVG %8.3f GB) Particles (TOTAL %lu) (AVG %lu) (MAX %lu) (MIN %lu) \n", timestep_count, (arr_usage_total + stl_usage_total + mesh_usage_total), (arr_usage_total + stl_usage_total + mesh_usage_total) / mpi_config->particle_flow_world_size, 
+                                                                                                                              total_particles_in_simulation,                           total_particles_in_simulation                         / mpi_config->particle_flow_world_size,
+                                                                                                                              max_particles_in_simulation,                             min_particles_in_simulation);
 
             }
         }
 
 
+        if ( rebalance_frequency && timestep_count && (timestep_count % rebalance_frequency) == 0 )
+            rebalance_particles();
+
         particle_release();
 
-        if (mpi_config->world_size != 1 && (count % comms_timestep) == 0)
+        if ( decompose_particles )
+            migrate_particles();
+
+        if ( merge_frequency )
+            merge_particles();
+
+        if ( sort_frequency )
+            sort_particles();
+
+        if (mpi_config->world_size != 1 && (timestep_count % comms_timestep) == 0)
             update_flow_field();
         
-        solve_spray_equations();
+        if (FUSED_PARTICLE_KERNEL)
+        {
+            solve_particles_fused();
+        }
+        else
+        {
+            solve_spray_equations();
+
+            update_particle_positions();
+        }
 
-        update_particle_positions();
+        if ( sort_frequency )
+            measure_sort_benefit();
 
         logger.avg_particles += (double)particles.size() / (double)num_timesteps;
 
-        count++;
+        particles.release_free_chunks();
+
+        timestep_count++;
 
         if (PARTICLE_SOLVER_DEBUG && mpi_config->rank == mpi_config->particle_flow_rank )  printf("Rank %d: Stop particle timestep\n", mpi_config->rank);
     }
@@ -0,0 +1,472 @@
+#pragma once
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <vector>
+
+#include "utils/utils.hpp"
+#include "particles/Particle.hpp"
+
+namespace minicombust::particles
+{
+    using namespace std;
+    using namespace minicombust::utils;
+
+    #define PARTICLE_STORE_ALIGNMENT    64
+    #define PARTICLE_STORE_MAX_PARTICLES (1ULL << 28) // Particles of address space first reserved for each column.
+
+    template<class T>
+    struct vec_column
+    {
+        T *x = nullptr;
+        T *y = nullptr;
+        T *z = nullptr;
+
+        inline vec<T> get(uint64_t i) const
+        {
+            return {x[i], y[i], z[i]};
+        }
+
+        inline void set(uint64_t i, const vec<T>& v)
+        {
+            x[i] = v.x;
+            y[i] = v.y;
+            z[i] = v.z;
+        }
+    };
+
+    // Structure-of-arrays particle storage. Every column is PARTICLE_STORE_ALIGNMENT aligned so kernels only stream the fields they use.
+    // Particle<T> remains the AoS record used to create, send and recieve particles.
+    //
+    // Memory is a chunked pool. Each column has address space for reserved_particles reserved up front, so columns never move
+    // as they grow, and memory is committed PARTICLE_POOL_CHUNK particles at a time. Chunks freed as particles decay are kept
+    // for reuse, and those beyond PARTICLE_POOL_FREE_CHUNKS are returned to the OS by release_free_chunks, so the footprint
+    // follows the live particle count rather than the most particles ever held.
+    template<class T>
+    class ParticleStore
+    {
+        private:
+            uint64_t particles_size     = 0;
+            uint64_t particles_capacity = 0;   // Particles in resident chunks
+
+            uint8_t *block              = nullptr;   // Address space reserved for every column
+            size_t   block_size         = 0;
+            uint64_t reserved_particles = 0;
+            vector<size_t> column_offsets;
+            size_t   particle_bytes     = 0;   // Bytes of one particle across every column
+
+            uint64_t resident_chunks    = 0;   // Chunks holding memory, the in use chunks then the free chunks
+            uint64_t mapped_chunks      = 0;   // Chunks made accessible, memory is only committed when touched
+            uint64_t peak_chunks        = 0;
+
+            vector<pair<void **, size_t>> columns;
+
+            // Counting sort buffers, kept between sorts.
+            uint64_t *sort_order          = nullptr;
+            uint64_t *sort_counts         = nullptr;
+            uint8_t  *sort_scratch        = nullptr;
+            uint64_t  sort_order_size     = 0;
+            uint64_t  sort_counts_size    = 0;
+
+            inline void add_column(void **column, size_t element_size)
+            {
+                columns.push_back({column, element_size});
+            }
+
+            inline void add_column(vec_column<T>& column)
+            {
+                add_column((void **)&column.x, sizeof(T));
+                add_column((void **)&column.y, sizeof(T));
+                add_column((void **)&column.z, sizeof(T));
+            }
+
+            // Byte range of chunk k in column c, rounded out to whole pages (round_out) or in to the pages only it uses.
+            inline pair<uint8_t *, size_t> chunk_pages(uint64_t c, uint64_t k, bool round_out) const
+            {
+                const uintptr_t page  = 4096;
+                const uintptr_t begin = (uintptr_t)block + column_offsets[c] + k       * PARTICLE_POOL_CHUNK * columns[c].second;
+                const uintptr_t end   = (uintptr_t)block + column_offsets[c] + (k + 1) * PARTICLE_POOL_CHUNK * columns[c].second;
+                const uintptr_t first = round_out ? (begin / page) * page                 : ((begin + page - 1) / page) * page;
+                const uintptr_t last  = round_out ? ((end + page - 1) / page) * page      : (end / page) * page;
+                return { (uint8_t *)first, (last > first) ? last - first : 0 };
+            }
+
+            // Reserves address space for new_reserved_particles in every column, moving any particles from the old reservation.
+            void reserve_address_space(uint64_t new_reserved_particles)
+            {
+                // Each column starts a different number of alignments past a page boundary, otherwise page aligned columns map
+                // element p of every column to the same cache set and the kernels thrash.
+                const size_t page = 4096;
+                vector<size_t> new_offsets(columns.size());
+                size_t offset = 0;
+                for ( uint64_t c = 0; c < columns.size(); c++ )
+                {
+                    offset         = ((offset + page - 1) / page) * page + (c * PARTICLE_STORE_ALIGNMENT) % page;
+                    new_offsets[c] = offset;
+                    offset        += new_reserved_particles * columns[c].second;
+                }
+                const size_t new_block_size = ((offset + page - 1) / page) * page;
+
+                uint8_t *new_block = (uint8_t *)mmap(nullptr, new_block_size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+                if ( new_block == MAP_FAILED )
+                {
+                    printf("ERROR: Failed to reserve %.2f GB of particle store address space\n", (double)new_block_size / 1.e9);
+                    exit(EXIT_FAILURE);
+                }
+                if ( PARTICLE_POOL_HUGE_PAGES )  madvise(new_block, new_block_size, MADV_HUGEPAGE);
+
+                uint8_t *old_block      = block;
+                const size_t old_size   = block_size;
+                const vector<size_t> old_offsets = column_offsets;
+
+                block              = new_block;
+                block_size         = new_block_size;
+                reserved_particles = new_reserved_particles;
+                column_offsets     = new_offsets;
+
+                const uint64_t chunks = mapped_chunks;
+                mapped_chunks = 0;
+                map_chunks(chunks);
+
+                for ( uint64_t c = 0; c < columns.size(); c++ )
+                {
+                    if ( old_block != nullptr )
+                        memcpy(block + column_offsets[c], old_block + old_offsets[c], particles_size * columns[c].second);
+                    *columns[c].first = block + column_offsets[c];
+                }
+                if ( old_block != nullptr )  munmap(old_block, old_size);
+            }
+
+            inline void map_chunks(uint64_t chunks)
+            {
+                for ( ; mapped_chunks < chunks; mapped_chunks++ )
+                {
+                    for ( uint64_t c = 0; c < columns.size(); c++ )
+                    {
+                        const auto pages = chunk_pages(c, mapped_chunks, true);
+                        if ( mprotect(pages.first, pages.second, PROT_READ | PROT_WRITE) != 0 )
+                        {
+                            printf("ERROR: Failed to map particle store chunk %lu\n", mapped_chunks);
+                            exit(EXIT_FAILURE);
+                        }
+                    }
+                }
+            }
+
+        public:
+            vec_column<T> x1;              // Position
+            vec_column<T> v1;              // Velocity
+            vec_column<T> a1;              // Acceleration
+            T            *mass;
+            T            *temp;
+            T            *diameter;
+            T            *age;
+            T            *weight;          // Droplets per particle
+            uint64_t     *cell;
+            uint64_t     *id;
+            bool         *decayed;
+
+            // Interpolated flow values at each particle
+            vec_column<T> gas_vel;
+            T            *gas_pressure;
+            T            *gas_temp;
+
+            // Source terms of each particle for its cell, summed over its droplets
+            vec_column<T> momentum;
+            T            *energy;
+            T            *fuel;
+
+            ParticleStore()
+            {
+                add_column(x1);
+                add_column(v1);
+                add_column(a1);
+                add_column((void **)&mass,         sizeof(T));
+                add_column((void **)&temp,         sizeof(T));
+                add_column((void **)&diameter,     sizeof(T));
+                add_column((void **)&age,          sizeof(T));
+                add_column((void **)&weight,       sizeof(T));
+                add_column((void **)&cell,         sizeof(uint64_t));
+                add_column((void **)&id,           sizeof(uint64_t));
+                add_column((void **)&decayed,      sizeof(bool));
+                add_column(gas_vel);
+                add_column((void **)&gas_pressure, sizeof(T));
+                add_column((void **)&gas_temp,     sizeof(T));
+                add_column(momentum);
+                add_column((void **)&energy,       sizeof(T));
+                add_column((void **)&fuel,         sizeof(T));
+
+                for ( auto& column : columns )
+                {
+                    *column.first   = nullptr;
+                    particle_bytes += column.second;
+                }
+            }
+
+            ~ParticleStore()
+            {
+                if ( block != nullptr )  munmap(block, block_size);
+                free(sort_order);
+                free(sort_counts);
+                free(sort_scratch);
+            }
+
+            ParticleStore(const ParticleStore&)            = delete;
+            ParticleStore& operator=(const ParticleStore&) = delete;
+
+            inline uint64_t size() const
+            {
+                return particles_size;
+            }
+
+            inline uint64_t capacity() const
+            {
+                return particles_capacity;
+            }
+
+            // Makes chunks resident until there is room for new_capacity particles. Free chunks are reused first.
+            void reserve(uint64_t new_capacity)
+            {
+                if ( new_capacity <= particles_capacity )  return;
+
+                const uint64_t chunks = (new_capacity + PARTICLE_POOL_CHUNK - 1) / PARTICLE_POOL_CHUNK;
+                if ( block == nullptr || chunks * PARTICLE_POOL_CHUNK > reserved_particles )
+                {
+                    uint64_t new_reserved_particles = max(reserved_particles, (uint64_t)PARTICLE_STORE_MAX_PARTICLES);
+                    while ( new_reserved_particles < chunks * PARTICLE_POOL_CHUNK )  new_reserved_particles *= 2;
+                    reserve_address_space(new_reserved_particles);
+                }
+
+                map_chunks(chunks);
+
+                resident_chunks    = max(resident_chunks, chunks);
+                peak_chunks        = max(peak_chunks, resident_chunks);
+                particles_capacity = resident_chunks * PARTICLE_POOL_CHUNK;
+            }
+
+            // Returns the memory of free chunks beyond PARTICLE_POOL_FREE_CHUNKS to the OS. Their pages read as zero if reused.
+            void release_free_chunks()
+            {
+                const uint64_t used_chunks = (particles_size + PARTICLE_POOL_CHUNK - 1) / PARTICLE_POOL_CHUNK;
+                while ( resident_chunks > used_chunks + PARTICLE_POOL_FREE_CHUNKS )
+                {
+                    resident_chunks--;
+                    for ( uint64_t c = 0; c < columns.size(); c++ )
+                    {
+                        const auto pages = chunk_pages(c, resident_chunks, false);
+                        if ( pages.second )  madvise(pages.first, pages.second, MADV_DONTNEED);
+                    }
+                }
+                particles_capacity = resident_chunks * PARTICLE_POOL_CHUNK;
+            }
+
+            inline uint64_t get_resident_chunks() const
+            {
+                return resident_chunks;
+            }
+
+            inline uint64_t get_peak_chunks() const
+            {
+                return peak_chunks;
+            }
+
+            inline size_t get_chunk_size() const
+            {
+                return PARTICLE_POOL_CHUNK * particle_bytes;
+            }
+
+            inline void clear()
+            {
+                particles_size = 0;
+            }
+
+            inline void append(const Particle<T>& particle)
+            {
+                if ( particles_size == particles_capacity )  reserve(particles_size + 1);
+
+                const uint64_t p = particles_size++;
+                x1.set(p, particle.x1);
+                v1.set(p, particle.v1);
+                a1.set(p, particle.a1);
+                mass[p]         = particle.mass;
+                temp[p]         = particle.temp;
+                diameter[p]     = particle.diameter;
+                age[p]          = particle.age;
+                weight[p]       = particle.weight;
+                cell[p]         = particle.cell;
+                id[p]           = particle.id;
+                decayed[p]      = particle.decayed;
+                gas_vel.set(p, particle.local_flow_value.vel);
+                gas_pressure[p] = particle.local_flow_value.pressure;
+                gas_temp[p]     = particle.local_flow_value.temp;
+                momentum.set(p, particle.particle_cell_fields.momentum);
+                energy[p]       = particle.particle_cell_fields.energy;
+                fuel[p]         = particle.particle_cell_fields.fuel;
+            }
+
+            // Appends count particles, making room for all of them at once.
+            inline void append(const Particle<T> *batch, uint64_t count)
+            {
+                reserve(particles_size + count);
+
+                for ( uint64_t i = 0; i < count; i++ )
+                    append(batch[i]);
+            }
+
+            inline void append(const particle_state_aos<T>& state)
+            {
+                append(Particle<T>(state));
+            }
+
+            inline Particle<T> get(uint64_t p) const
+            {
+                Particle<T> particle(x1.get(p), v1.get(p), a1.get(p), mass[p], temp[p], diameter[p], cell[p], id[p]);
+                particle.age                  = age[p];
+                particle.weight               = weight[p];
+                particle.decayed              = decayed[p];
+                particle.local_flow_value     = {gas_vel.get(p), gas_pressure[p], gas_temp[p]};
+                particle.particle_cell_fields = {momentum.get(p), energy[p], fuel[p]};
+                return particle;
+            }
+
+            inline particle_state_aos<T> get_state(uint64_t p) const
+            {
+                return {x1.get(p), v1.get(p), a1.get(p), mass[p], temp[p], diameter[p], age[p], weight[p], cell[p], id[p]};
+            }
+
+            inline void set_state(uint64_t p, const particle_state_aos<T>& state)
+            {
+                x1.set(p, state.x1);
+                v1.set(p, state.v1);
+                a1.set(p, state.a1);
+                mass[p]     = state.mass;
+                temp[p]     = state.temp;
+                diameter[p] = state.diameter;
+                age[p]      = state.age;
+                weight[p]   = state.weight;
+                cell[p]     = state.cell;
+                id[p]       = state.id;
+            }
+
+            inline particle_aos<T> get_cell_fields(uint64_t p) const
+            {
+                return {momentum.get(p), energy[p], fuel[p]};
+            }
+
+            // Moves the kept elements of one column down over the decayed ones, from the first decayed particle on. Every element
+            // is written and the write index only advances past kept ones, so the loop has no branches.
+            template<typename E>
+            inline uint64_t compact_column(E *data, uint64_t first)
+            {
+                uint64_t kept = first;
+                for ( uint64_t p = first; p < particles_size; p++ )
+                {
+                    data[kept] = data[p];
+                    kept      += !decayed[p];
+                }
+                return kept;
+            }
+
+            // Removes decayed particles in one pass over each column without allocating. The other particles keep their order,
+            // so particles sorted by cell stay sorted, and those before the first decayed particle are not moved. Kernels flag
+            // particles in decayed and remove them all here, at the end of the kernel.
+            inline void remove_decayed()
+            {
+                uint64_t first = 0;
+                while ( first < particles_size && !decayed[first] )  first++;
+                if ( first == particles_size )  return;
+
+                // The decayed column is the predicate, so it is compacted last. Every kept particle is live.
+                uint64_t kept = first;
+                for ( auto& column : columns )
+                {
+                    if ( column.first == (void **)&decayed )  continue;
+
+                    uint8_t *data = (uint8_t *)*column.first;
+                    if      ( column.second == sizeof(uint64_t) )  kept = compact_column((uint64_t *)data, first);
+                    else if ( column.second == sizeof(uint32_t) )  kept = compact_column((uint32_t *)data, first);
+                    else if ( column.second == sizeof(uint8_t) )   kept = compact_column(data, first);
+                    else
+                    {
+                        kept = first;
+                        for ( uint64_t p = first; p < particles_size; p++ )
+                        {
+                            memmove(data + kept * column.second, data + p * column.second, column.second);
+                            kept += !decayed[p];
+                        }
+                    }
+                }
+                memset(decayed + first, 0, (kept - first) * sizeof(bool));
+
+                particles_size = kept;
+            }
+
+            inline void pop_back()
+            {
+                particles_size--;
+            }
+
+            // Stable counting sort of the particles by cell, so kernels gather mesh and flow data in memory order. Cells are
+            // bucketed by their offset from the lowest cell, coarsened by powers of two until there are no more buckets than
+            // particles. Coarse buckets hold runs of consecutive cells, which are neighbours in the structured meshes.
+            void sort_by_cell()
+            {
+                if ( particles_size < 2 )  return;
+
+                uint64_t min_cell = cell[0], max_cell = cell[0];
+                for ( uint64_t p = 1; p < particles_size; p++ )
+                {
+                    min_cell = min(min_cell, cell[p]);
+                    max_cell = max(max_cell, cell[p]);
+                }
+
+                uint64_t shift = 0;
+                while ( ((max_cell - min_cell) >> shift) >= particles_size )  shift++;
+                const uint64_t buckets = ((max_cell - min_cell) >> shift) + 1;
+
+                if ( sort_order_size < particles_size )
+                {
+                    sort_order_size = particles_capacity;
+                    sort_order      = (uint64_t *)realloc(sort_order,   sort_order_size * sizeof(uint64_t));
+                    sort_scratch    = (uint8_t  *)realloc(sort_scratch, sort_order_size * sizeof(uint64_t));
+                }
+                if ( sort_counts_size < buckets + 1 )
+                {
+                    sort_counts_size = buckets + 1;
+                    sort_counts      = (uint64_t *)realloc(sort_counts, sort_counts_size * sizeof(uint64_t));
+                }
+
+                memset(sort_counts, 0, (buckets + 1) * sizeof(uint64_t));
+                for ( uint64_t p = 0; p < particles_size; p++ )
+                    sort_counts[((cell[p] - min_cell) >> shift) + 1]++;
+                for ( uint64_t b = 1; b <= buckets; b++ )
+                    sort_counts[b] += sort_counts[b - 1];
+                for ( uint64_t p = 0; p < particles_size; p++ )
+                    sort_order[sort_counts[(cell[p] - min_cell) >> shift]++] = p;
+
+                // Gather every column through the scratch buffer.
+                for ( auto& column : columns )
+                {
+                    uint8_t *data = (uint8_t *)*column.first;
+                    if ( column.second == sizeof(uint64_t) )
+                    {
+                        const uint64_t *src = (const uint64_t *)data;
+                        uint64_t       *dst = (uint64_t *)sort_scratch;
+                        for ( uint64_t i = 0; i < particles_size; i++ )  dst[i] = src[sort_order[i]];
+                    }
+                    else
+                    {
+                        for ( uint64_t i = 0; i < particles_size; i++ )  memcpy(sort_scratch + i * column.second, data + sort_order[i] * column.second, column.second);
+                    }
+                    memcpy(data, sort_scratch, particles_size * column.second);
+                }
+            }
+
+            size_t get_memory_usage() const
+            {
+                return resident_chunks * get_chunk_size() + (2 * sort_order_size + sort_counts_size) * sizeof(uint64_t);
+            }
+    }; // class ParticleStore
+
+}   // namespace minicombust::particles
@@ -39,6 +39,10 @@ namespace minicombust::performance
             int128_t *particle_interpolation_event_counts;
             int128_t *emit_event_counts;
             int128_t *update_flow_field_event_counts;
+            int128_t *migration_event_counts;
+            int128_t *sort_event_counts;
+            int128_t *merge_event_counts;
+            int128_t *fused_kernel_event_counts;
 
             double position_time = 0.;
             double interpolation_time = 0.;
@@ -46,6 +50,10 @@ namespace minicombust::performance
             double spray_time = 0.;
             double emit_time = 0.;
             double update_flow_field_time = 0.;
+            double migration_time = 0.;
+            double sort_time = 0.;
+            double merge_time = 0.;
+            double fused_kernel_time = 0.;
             double output; 
             
             vector<string> event_names;
@@ -85,6 +93,12 @@ namespace minicombust::performance
                 #endif
                 myfile << endl;
 
+                myfile << "fused_particle_kernel," << fused_kernel_time;
+                #ifdef PAPI
+                for (int e = 0; e < num_events; e++)    myfile << "," << fused_kernel_event_counts[e];
+                #endif
+                myfile << endl;
+
                 myfile << "emitted_particles," << emit_time;
                 #ifdef PAPI
                 for (int e = 0; e < num_events; e++)    myfile << "," << emit_event_counts[e];
@@ -97,11 +111,29 @@ namespace minicombust::performance
                 #endif
                 myfile << endl;
 
+                myfile << "migrate_particles," << migration_time;
+                #ifdef PAPI
+                for (int e = 0; e < num_events; e++)    myfile << "," << migration_event_counts[e];
+                #endif
+                myfile << endl;
+
+                myfile << "sort_particles," << sort_time;
+                #ifdef PAPI
+                for (int e = 0; e < num_events; e++)    myfile << "," << sort_event_counts[e];
+                #endif
+                myfile << endl;
+
+                myfile << "merge_particles," << merge_time;
+                #ifdef PAPI
+                for (int e = 0; e < num_events; e++)    myfile << "," << merge_event_counts[e];
+                #endif
+                myfile << endl;
+
                 myfile << "minicombust," << runtime;
                 #ifdef PAPI
                 for (int e = 0; e < num_events; e++)    
                 {
-                    myfile << "," << update_flow_field_event_counts[e] + interpolation_kernel_event_counts[e] + particle_interpolation_event_counts[e] + spray_kernel_event_counts[e] + position_kernel_event_counts[e] + emit_event_counts[e];
+                    myfile << "," << update_flow_field_event_counts[e] + interpolation_kernel_event_counts[e] + particle_interpolation_event_counts[e] + spray_kernel_event_counts[e] + position_kernel_event_counts[e] + emit_event_counts[e] + migration_event_counts[e] + sort_event_counts[e] + merge_event_counts[e] + fused_kernel_event_counts[e];
                 }
                 #endif
                 myfile << endl;
@@ -110,6 +142,36 @@ namespace minicombust::performance
             }
 
 
+            // Cost of a kernel in the first PAPI event when one is counted, otherwise in seconds. Listing a cache miss event
+            // (e.g. PAPI_L2_TCM) first in PAPI.CONFIG makes cost comparisons between kernels measure memory locality.
+            inline double get_cost(const int128_t *kernel_event_counts, double time)
+            {
+                (void)(kernel_event_counts);
+
+                #ifdef PAPI
+                if (event_set != PAPI_NULL && num_events > 0)  return (double)kernel_event_counts[0];
+                #endif
+                return time;
+            }
+
+            inline string get_cost_unit()
+            {
+                #ifdef PAPI
+                if (event_set != PAPI_NULL && num_events > 0)  return event_names[0];
+                #endif
+                return "s";
+            }
+
+            inline double get_particle_kernel_cost()
+            {
+                return get_cost(particle_interpolation_event_counts, particle_interpolation_time) + get_cost(spray_kernel_event_counts, spray_time) + get_cost(position_kernel_event_counts, position_time) + get_cost(fused_kernel_event_counts, fused_kernel_time);
+            }
+
+            inline double get_sort_cost()
+            {
+                return get_cost(sort_event_counts, sort_time);
+            }
+
             inline void my_papi_start()
             {
                 #ifdef PAPI
@@ -310,6 +372,30 @@ namespace minicombust::performance
                     update_flow_field_event_counts[i] = 0;
                 }
 
+                migration_event_counts = (int128_t*)malloc(sizeof(int128_t)*num_events);
+                for (int i = 0; i < num_events; i++) 
+                {
+                    migration_event_counts[i] = 0;
+                }
+
+                sort_event_counts = (int128_t*)malloc(sizeof(int128_t)*num_events);
+                for (int i = 0; i < num_events; i++) 
+                {
+                    sort_event_counts[i] = 0;
+                }
+
+                merge_event_counts = (int128_t*)malloc(sizeof(int128_t)*num_events);
+                for (int i = 0; i < num_events; i++) 
+                {
+                    merge_event_counts[i] = 0;
+                }
+
+                fused_kernel_event_counts = (int128_t*)malloc(sizeof(int128_t)*num_events);
+                for (int i = 0; i < num_events; i++) 
+                {
+                    fused_kernel_event_counts[i] = 0;
+                }
+
 
                 temp_count_store = (int128_t*)malloc(sizeof(int128_t)*num_events);
                 for (int e = 0; e < num_events; e++)
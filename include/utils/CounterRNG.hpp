@@ -0,0 +1,75 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "utils/utils.hpp"
+
+namespace minicombust::utils
+{
+    // Counter-based random numbers (Philox4x32-10, Salmon et al. SC'11). Every draw is a pure function of
+    // (seed, stream, particle id, timestep, draw index), so results don't depend on rank count, thread count or iteration
+    // order, and draws can be made from vectorised or threaded loops without shared state.
+
+    // Streams seperate the draws made for different purposes by the same particle in the same timestep.
+    enum RANDOM_STREAM { STREAM_EMIT = 0, STREAM_BREAKUP = 2 };
+
+    static inline void philox4x32_10 (uint32_t ctr[4], uint32_t key0, uint32_t key1)
+    {
+        #pragma unroll
+        for (int round = 0; round < 10; round++)
+        {
+            const uint64_t product0 = (uint64_t)0xD2511F53 * ctr[0];
+            const uint64_t product1 = (uint64_t)0xCD9E8D57 * ctr[2];
+
+            const uint32_t c0 = (uint32_t)(product1 >> 32) ^ ctr[1] ^ key0;
+            const uint32_t c2 = (uint32_t)(product0 >> 32) ^ ctr[3] ^ key1;
+            ctr[1] = (uint32_t)product1;
+            ctr[3] = (uint32_t)product0;
+            ctr[0] = c0;
+            ctr[2] = c2;
+
+            key0 += 0x9E3779B9;
+            key1 += 0xBB67AE85;
+        }
+    }
+
+    static inline uint64_t counter_bits (uint64_t seed, uint32_t stream, uint64_t id, uint64_t timestep, uint64_t draw)
+    {
+        uint32_t ctr[4] = { (uint32_t)id, (uint32_t)(id >> 32), (uint32_t)timestep, (uint32_t)draw };
+        philox4x32_10(ctr, (uint32_t)seed ^ (uint32_t)(seed >> 32), stream);
+        return ((uint64_t)ctr[0] << 32) | ctr[1];
+    }
+
+    // Uniform double in [0, 1) with 53 random bits.
+    static inline double counter_uniform (uint64_t seed, uint32_t stream, uint64_t id, uint64_t timestep, uint64_t draw)
+    {
+        return (counter_bits(seed, stream, id, timestep, draw) >> 11) * 0x1.0p-53;
+    }
+
+    // Sequential draws for one (seed, stream, particle id, timestep).
+    struct random_stream
+    {
+        uint64_t seed;
+        uint32_t stream;
+        uint64_t id;
+        uint64_t timestep;
+        uint64_t draw = 0;
+
+        inline double uniform ()
+        {
+            return counter_uniform(seed, stream, id, timestep, draw++);
+        }
+
+        inline vec<double> uniform_vec ()
+        {
+            const double x = uniform();
+            const double y = uniform();
+            return { x, y, uniform() };
+        }
+
+        inline uint64_t bits ()
+        {
+            return counter_bits(seed, stream, id, timestep, draw++);
+        }
+    };
+}
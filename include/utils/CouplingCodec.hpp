@@ -0,0 +1,277 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include <algorithm>
+
+#include "utils/utils.hpp"
+
+namespace minicombust::utils
+{
+    using namespace std;
+
+    // Encoding used for the particle <-> flow coupling messages.
+    //     CODEC_NONE:      Seperate uint64_t id and field messages (original protocol).
+    //     CODEC_LOSSLESS:  Single message, sorted ids delta + varint encoded, fields copied as T.
+    //     CODEC_FLOAT32:   As lossless, fields truncated to float.
+    //     CODEC_QUANTISED: As lossless, each field component quantised to (max - min) * tolerance absolute error, varint encoded.
+    enum CODEC_MODE { CODEC_NONE = 0, CODEC_LOSSLESS = 1, CODEC_FLOAT32 = 2, CODEC_QUANTISED = 3 };
+
+    inline constexpr const char *codec_mode_names[] = { "none", "lossless", "float32", "quantised" };
+
+    template<class T>
+    class CouplingCodec
+    {
+        private:
+            vector<uint8_t *> buffers;
+            vector<size_t>    buffer_sizes;
+            vector<uint64_t>  order;
+
+            inline uint8_t *put_varint(uint8_t *ptr, uint64_t value)
+            {
+                while ( value >= 0x80 )
+                {
+                    *ptr++  = (uint8_t)(value | 0x80);
+                    value >>= 7;
+                }
+                *ptr++ = (uint8_t)value;
+                return ptr;
+            }
+
+            inline const uint8_t *get_varint(const uint8_t *ptr, uint64_t *value)
+            {
+                uint64_t result = 0;
+                int      shift  = 0;
+                while ( *ptr & 0x80 )
+                {
+                    result |= ((uint64_t)(*ptr++ & 0x7F)) << shift;
+                    shift  += 7;
+                }
+                *value = result | (((uint64_t)*ptr++) << shift);
+                return ptr;
+            }
+
+        public:
+            CODEC_MODE mode;
+            T          tolerance;
+
+            // Stats
+            double raw_bytes     = 0.;
+            double encoded_bytes = 0.;
+            double encode_time   = 0.;
+            double decode_time   = 0.;
+
+            CouplingCodec(CODEC_MODE mode, T tolerance) : mode(mode), tolerance(tolerance)
+            {
+                if ( mode == CODEC_QUANTISED && !(tolerance > 0.0) )
+                {
+                    printf("ERROR: Quantised coupling codec requires a positive tolerance (got %f)\n", tolerance);
+                    exit(1);
+                }
+            }
+
+            ~CouplingCodec()
+            {
+                for ( uint64_t i = 0; i < buffers.size(); i++ )  free(buffers[i]);
+            }
+
+            inline bool enabled ()
+            {
+                return mode != CODEC_NONE;
+            }
+
+            // Buffers are indexed by slot so that seperate in-flight messages never share memory.
+            inline uint8_t *get_buffer (uint64_t slot, size_t bytes)
+            {
+                while ( buffers.size() <= slot )
+                {
+                    buffer_sizes.push_back(1024);
+                    buffers.push_back((uint8_t *)malloc(buffer_sizes.back()));
+                }
+
+                if ( buffer_sizes[slot] < bytes )
+                {
+                    while ( buffer_sizes[slot] < bytes )  buffer_sizes[slot] *= 2;
+                    buffers[slot] = (uint8_t *)realloc(buffers[slot], buffer_sizes[slot]);
+                }
+                return buffers[slot];
+            }
+
+            template<typename F>
+            inline size_t max_encoded_size (uint64_t elements)
+            {
+                const uint64_t components = sizeof(F) / sizeof(T);
+                return 2 * 10 + 2 * components * sizeof(T) + elements * (10 + max(sizeof(F), 10 * components));
+            }
+
+            // Encodes ids and fields into the slot buffer, returns the number of bytes to send.
+            template<typename F>
+            size_t encode (uint64_t slot, const uint64_t *ids, const F *fields, uint64_t elements, uint8_t **buffer)
+            {
+                static_assert(sizeof(F) % sizeof(T) == 0, "Coupling codec fields must be made up of T components");
+                const uint64_t components = sizeof(F) / sizeof(T);
+
+                encode_time -= MPI_Wtime();
+
+                *buffer      = get_buffer(slot, max_encoded_size<F>(elements));
+                uint8_t *ptr = *buffer;
+
+                // Sorting ids keeps the deltas small, receivers don't depend on message order.
+                order.resize(elements);
+                for ( uint64_t i = 0; i < elements; i++ )  order[i] = i;
+                sort(order.begin(), order.end(), [ids] (uint64_t a, uint64_t b) { return ids[a] < ids[b]; });
+
+                ptr = put_varint(ptr, elements);
+
+                uint64_t prev_id = 0;
+                for ( uint64_t i = 0; i < elements; i++ )
+                {
+                    ptr     = put_varint(ptr, ids[order[i]] - prev_id);
+                    prev_id = ids[order[i]];
+                }
+
+                if ( mode == CODEC_LOSSLESS )
+                {
+                    for ( uint64_t i = 0; i < elements; i++ )
+                    {
+                        memcpy(ptr, &fields[order[i]], sizeof(F));
+                        ptr += sizeof(F);
+                    }
+                }
+                else if ( mode == CODEC_FLOAT32 )
+                {
+                    for ( uint64_t i = 0; i < elements; i++ )
+                    {
+                        const T *values = (const T *)&fields[order[i]];
+                        for ( uint64_t c = 0; c < components; c++ )
+                        {
+                            const float value = (float)values[c];
+                            memcpy(ptr, &value, sizeof(float));
+                            ptr += sizeof(float);
+                        }
+                    }
+                }
+                else if ( mode == CODEC_QUANTISED )
+                {
+                    T min_values[components], steps[components];
+                    for ( uint64_t c = 0; c < components; c++ )
+                    {
+                        T min_value = __DBL_MAX__, max_value = -__DBL_MAX__;
+                        for ( uint64_t i = 0; i < elements; i++ )
+                        {
+                            const T value = ((const T *)&fields[i])[c];
+                            min_value = min(min_value, value);
+                            max_value = max(max_value, value);
+                        }
+                        if ( elements == 0 )  min_value = max_value = 0.0;
+
+                        // Rounding to the nearest step gives an error of at most half a step.
+                        min_values[c] = min_value;
+                        steps[c]      = 2.0 * tolerance * (max_value - min_value);
+
+                        memcpy(ptr, &min_values[c], sizeof(T));  ptr += sizeof(T);
+                        memcpy(ptr, &steps[c],      sizeof(T));  ptr += sizeof(T);
+                    }
+
+                    for ( uint64_t i = 0; i < elements; i++ )
+                    {
+                        const T *values = (const T *)&fields[order[i]];
+                        for ( uint64_t c = 0; c < components; c++ )
+                        {
+                            const uint64_t q = (steps[c] > 0.0) ? (uint64_t)llround((values[c] - min_values[c]) / steps[c]) : 0;
+                            ptr = put_varint(ptr, q);
+                        }
+                    }
+                }
+
+                const size_t bytes = ptr - *buffer;
+
+                raw_bytes     += elements * (sizeof(uint64_t) + sizeof(F));
+                encoded_bytes += bytes;
+                encode_time   += MPI_Wtime();
+
+                return bytes;
+            }
+
+            inline uint64_t decode_size (const uint8_t *buffer)
+            {
+                uint64_t elements;
+                get_varint(buffer, &elements);
+                return elements;
+            }
+
+            // Decodes a message into caller arrays, sized using decode_size. Returns the number of elements.
+            template<typename F>
+            uint64_t decode (const uint8_t *buffer, uint64_t *ids, F *fields)
+            {
+                const uint64_t components = sizeof(F) / sizeof(T);
+
+                decode_time -= MPI_Wtime();
+
+                uint64_t elements;
+                const uint8_t *ptr = get_varint(buffer, &elements);
+
+                uint64_t id = 0;
+                for ( uint64_t i = 0; i < elements; i++ )
+                {
+                    uint64_t delta;
+                    ptr    = get_varint(ptr, &delta);
+                    id    += delta;
+                    ids[i] = id;
+                }
+
+                if ( mode == CODEC_LOSSLESS )
+                {
+                    memcpy(fields, ptr, elements * sizeof(F));
+                }
+                else if ( mode == CODEC_FLOAT32 )
+                {
+                    for ( uint64_t i = 0; i < elements; i++ )
+                    {
+                        T *values = (T *)&fields[i];
+                        for ( uint64_t c = 0; c < components; c++ )
+                        {
+                            float value;
+                            memcpy(&value, ptr, sizeof(float));
+                            ptr      += sizeof(float);
+                            values[c] = (T)value;
+                        }
+                    }
+                }
+                else if ( mode == CODEC_QUANTISED )
+                {
+                    T min_values[components], steps[components];
+                    for ( uint64_t c = 0; c < components; c++ )
+                    {
+                        memcpy(&min_values[c], ptr, sizeof(T));  ptr += sizeof(T);
+                        memcpy(&steps[c],      ptr, sizeof(T));  ptr += sizeof(T);
+                    }
+
+                    for ( uint64_t i = 0; i < elements; i++ )
+                    {
+                        T *values = (T *)&fields[i];
+                        for ( uint64_t c = 0; c < components; c++ )
+                        {
+                            uint64_t q;
+                            ptr       = get_varint(ptr, &q);
+                            values[c] = min_values[c] + q * steps[c];
+                        }
+                    }
+                }
+
+                decode_time += MPI_Wtime();
+
+                return elements;
+            }
+
+            size_t get_memory_usage ()
+            {
+                size_t total_buffer_size = 0;
+                for ( uint64_t i = 0; i < buffer_sizes.size(); i++ )  total_buffer_size += buffer_sizes[i];
+                return total_buffer_size + order.capacity() * sizeof(uint64_t);
+            }
+    };
+}
@@ -0,0 +1,334 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <utility>
+
+namespace minicombust::utils
+{
+    // Open addressing hash map for integer keys, used for the per timestep node and cell lookups of the particle solver.
+    //
+    // Slots are split into groups of 8, probed linearly group by group. Each slot has a one byte tag (empty, deleted, or full
+    // with 7 bits of the hash) and a group's 8 tags share one word, so a probe compares all 8 tags at once with word
+    // arithmetic before touching any keys. A probe ends at the first group with an empty slot.
+    //
+    // clear() is O(1). Each group records the generation it was last written in, and groups from an older generation read as
+    // empty. This keeps the table allocated across timesteps instead of freeing and reallocating nodes like unordered_map.
+    //
+    // Inserting may move every slot, so references to values are only valid until the next insert.
+    template<typename K, typename V>
+    class FlatHashMap
+    {
+        public:
+            struct slot
+            {
+                K first;
+                V second;
+            };
+
+        private:
+            static constexpr uint64_t GROUP_SIZE  = 8;
+            static constexpr uint64_t NPOS        = UINT64_MAX;
+
+            static constexpr uint8_t  TAG_EMPTY   = 0x00;
+            static constexpr uint8_t  TAG_DELETED = 0x01;
+            static constexpr uint8_t  TAG_FULL    = 0x80;
+
+            static constexpr uint64_t LOW_BITS    = 0x0101010101010101ULL;
+            static constexpr uint64_t HIGH_BITS   = 0x8080808080808080ULL;
+
+            slot     *slots             = nullptr;
+            uint64_t *group_tags        = nullptr;
+            uint32_t *group_generations = nullptr;
+
+            uint64_t  groups            = 0;
+            uint64_t  group_shift       = 64;
+            uint64_t  map_size          = 0;
+            uint64_t  deleted_size      = 0;
+            uint32_t  generation        = 1;
+
+            static inline uint64_t hash(K key)
+            {
+                return (uint64_t)key * 0x9E3779B97F4A7C15ULL;
+            }
+
+            static inline uint8_t hash_tag(uint64_t h)
+            {
+                return TAG_FULL | ((h >> 32) & 0x7f);
+            }
+
+            // High bit set in each byte of word that may equal byte. The lowest set byte is always a true match, but a byte equal to
+            // byte ^ 1 directly above a match is also set. Only the lowest match is used for empty and deleted slots, and full tag
+            // matches are confirmed by comparing keys.
+            static inline uint64_t match_tag(uint64_t word, uint8_t byte)
+            {
+                const uint64_t x = word ^ (LOW_BITS * byte);
+                return (x - LOW_BITS) & ~x & HIGH_BITS;
+            }
+
+            static inline uint64_t tag_offset(uint64_t match)
+            {
+                return __builtin_ctzll(match) >> 3;
+            }
+
+            inline uint8_t get_tag(uint64_t s) const
+            {
+                return (group_tags[s / GROUP_SIZE] >> (8 * (s % GROUP_SIZE))) & 0xff;
+            }
+
+            inline void set_tag(uint64_t s, uint8_t tag)
+            {
+                const uint64_t shift = 8 * (s % GROUP_SIZE);
+                group_tags[s / GROUP_SIZE] = (group_tags[s / GROUP_SIZE] & ~(0xffULL << shift)) | ((uint64_t)tag << shift);
+            }
+
+            inline bool is_full(uint64_t s) const
+            {
+                return group_generations[s / GROUP_SIZE] == generation && (get_tag(s) & TAG_FULL);
+            }
+
+            inline uint64_t find_slot(K key) const
+            {
+                if ( map_size == 0 )  return NPOS;
+
+                const uint64_t h   = hash(key);
+                const uint8_t  tag = hash_tag(h);
+                uint64_t       g   = h >> group_shift;
+                for ( uint64_t probe = 0; probe < groups; probe++ )
+                {
+                    if ( group_generations[g] != generation )  return NPOS;
+
+                    const uint64_t word = group_tags[g];
+                    for ( uint64_t match = match_tag(word, tag); match; match &= match - 1 )
+                    {
+                        const uint64_t s = g * GROUP_SIZE + tag_offset(match);
+                        if ( slots[s].first == key )  return s;
+                    }
+                    if ( match_tag(word, TAG_EMPTY) )  return NPOS;
+
+                    g = (g + 1) & (groups - 1);
+                }
+                return NPOS;
+            }
+
+            // Slot for a key known to be absent. Prefers the first deleted slot on the probe path.
+            inline uint64_t insert_slot(K key)
+            {
+                const uint64_t h   = hash(key);
+                const uint8_t  tag = hash_tag(h);
+                uint64_t       g   = h >> group_shift;
+                uint64_t       s   = NPOS;
+                for ( uint64_t probe = 0; probe < groups; probe++ )
+                {
+                    if ( group_generations[g] != generation )
+                    {
+                        group_generations[g] = generation;
+                        group_tags[g]        = 0;
+                        if ( s == NPOS )  s = g * GROUP_SIZE;
+                        break;
+                    }
+
+                    const uint64_t word    = group_tags[g];
+                    const uint64_t deleted = match_tag(word, TAG_DELETED);
+                    if ( s == NPOS && deleted )  s = g * GROUP_SIZE + tag_offset(deleted);
+
+                    const uint64_t empty = match_tag(word, TAG_EMPTY);
+                    if ( empty )
+                    {
+                        if ( s == NPOS )  s = g * GROUP_SIZE + tag_offset(empty);
+                        break;
+                    }
+
+                    g = (g + 1) & (groups - 1);
+                }
+
+                if ( get_tag(s) == TAG_DELETED && group_generations[s / GROUP_SIZE] == generation )  deleted_size--;
+                set_tag(s, tag);
+                slots[s].first  = key;
+                slots[s].second = V();
+                map_size++;
+                return s;
+            }
+
+            void rehash(uint64_t new_groups)
+            {
+                slot     *old_slots             = slots;
+                uint64_t *old_group_tags        = group_tags;
+                uint32_t *old_group_generations = group_generations;
+                const uint64_t old_groups       = groups;
+                const uint32_t old_generation   = generation;
+
+                groups            = new_groups;
+                group_shift       = 64 - __builtin_ctzll(new_groups);
+                slots             = (slot *)    malloc(groups * GROUP_SIZE * sizeof(slot));
+                group_tags        = (uint64_t *)calloc(groups, sizeof(uint64_t));
+                group_generations = (uint32_t *)calloc(groups, sizeof(uint32_t));
+                generation        = 1;
+                map_size          = 0;
+                deleted_size      = 0;
+
+                for ( uint64_t g = 0; g < old_groups; g++ )
+                {
+                    if ( old_group_generations[g] != old_generation )  continue;
+
+                    for ( uint64_t i = 0; i < GROUP_SIZE; i++ )
+                    {
+                        if ( !(((old_group_tags[g] >> (8 * i)) & 0xff) & TAG_FULL) )  continue;
+
+                        const slot& old_slot = old_slots[g * GROUP_SIZE + i];
+                        slots[insert_slot(old_slot.first)].second = old_slot.second;
+                    }
+                }
+
+                free(old_slots);
+                free(old_group_tags);
+                free(old_group_generations);
+            }
+
+        public:
+            class iterator
+            {
+                private:
+                    FlatHashMap *map;
+                    uint64_t     s;
+
+                    inline void skip_unused()
+                    {
+                        while ( s < map->groups * GROUP_SIZE && !map->is_full(s) )  s++;
+                    }
+
+                public:
+                    iterator(FlatHashMap *map, uint64_t s) : map(map), s(s)
+                    {
+                        skip_unused();
+                    }
+
+                    inline slot& operator*()  const { return map->slots[s]; }
+                    inline slot* operator->() const { return &map->slots[s]; }
+
+                    inline iterator& operator++()
+                    {
+                        s++;
+                        skip_unused();
+                        return *this;
+                    }
+
+                    inline bool operator!=(const iterator& other) const { return s != other.s; }
+                    inline bool operator==(const iterator& other) const { return s == other.s; }
+            };
+
+            FlatHashMap() = default;
+
+            FlatHashMap(FlatHashMap&& other) noexcept
+            {
+                *this = std::move(other);
+            }
+
+            FlatHashMap& operator=(FlatHashMap&& other) noexcept
+            {
+                std::swap(slots,             other.slots);
+                std::swap(group_tags,        other.group_tags);
+                std::swap(group_generations, other.group_generations);
+                std::swap(groups,            other.groups);
+                std::swap(group_shift,       other.group_shift);
+                std::swap(map_size,          other.map_size);
+                std::swap(deleted_size,      other.deleted_size);
+                std::swap(generation,        other.generation);
+                return *this;
+            }
+
+            FlatHashMap(const FlatHashMap&)            = delete;
+            FlatHashMap& operator=(const FlatHashMap&) = delete;
+
+            ~FlatHashMap()
+            {
+                free(slots);
+                free(group_tags);
+                free(group_generations);
+            }
+
+            inline uint64_t size() const
+            {
+                return map_size;
+            }
+
+            inline uint64_t count(K key) const
+            {
+                return find_slot(key) != NPOS;
+            }
+
+            // Pointer to the value of key, or nullptr if key is absent.
+            inline V *find(K key)
+            {
+                const uint64_t s = find_slot(key);
+                return (s == NPOS) ? nullptr : &slots[s].second;
+            }
+
+            inline const V *find(K key) const
+            {
+                const uint64_t s = find_slot(key);
+                return (s == NPOS) ? nullptr : &slots[s].second;
+            }
+
+            inline V& operator[](K key)
+            {
+                uint64_t s = find_slot(key);
+                if ( s != NPOS )  return slots[s].second;
+
+                // Keep an eighth of the slots empty so probes stay short. Mostly deleted tables are rehashed at the same size.
+                if ( groups == 0 )
+                    rehash(2);
+                else if ( 8 * (map_size + deleted_size + 1) > 7 * groups * GROUP_SIZE )
+                    rehash( (4 * (map_size + 1) > groups * GROUP_SIZE) ? 2 * groups : groups );
+
+                return slots[insert_slot(key)].second;
+            }
+
+            inline uint64_t erase(K key)
+            {
+                const uint64_t s = find_slot(key);
+                if ( s == NPOS )  return 0;
+
+                // Probes stop at groups with an empty slot, so a slot in such a group can be emptied rather than marked deleted.
+                if ( match_tag(group_tags[s / GROUP_SIZE], TAG_EMPTY) )
+                {
+                    set_tag(s, TAG_EMPTY);
+                }
+                else
+                {
+                    set_tag(s, TAG_DELETED);
+                    deleted_size++;
+                }
+                map_size--;
+                return 1;
+            }
+
+            inline void clear()
+            {
+                map_size     = 0;
+                deleted_size = 0;
+                if ( ++generation == 0 )
+                {
+                    memset(group_generations, 0, groups * sizeof(uint32_t));
+                    generation = 1;
+                }
+            }
+
+            void reserve(uint64_t elements)
+            {
+                uint64_t new_groups = 2;
+                while ( 7 * new_groups * GROUP_SIZE < 8 * elements )  new_groups *= 2;
+                if ( new_groups > groups )  rehash(new_groups);
+            }
+
+            inline iterator begin() { return iterator(this, 0); }
+            inline iterator end()   { return iterator(this, groups * GROUP_SIZE); }
+
+            size_t get_memory_usage() const
+            {
+                return groups * (GROUP_SIZE * sizeof(slot) + sizeof(uint64_t) + sizeof(uint32_t));
+            }
+    }; // class FlatHashMap
+
+}   // namespace minicombust::utils
@@ -23,6 +23,16 @@
 #define PARTICLE_SOLVER_DEBUG 0
 #define FLOW 0
 #define PARTICLE 1
+#define BATCHED_SPRAY 1 // Vectorised spray kernel with polynomial exp/log/pow (utils/FastMath.hpp). 0 runs the scalar libm kernel.
+#define FUSED_PARTICLE_KERNEL 1 // Interpolate, spray and position particles chunk by chunk in one pass. 0 runs each kernel over all particles.
+#define FUSED_KERNEL_CHUNK 256 // Particles per chunk of the fused kernel, sized so a chunk's columns stay in L2.
+#define SPRAY_MAX_SUBSTEPS 1000 // Most sub-steps a stiff droplet takes in one timestep. The last sub-step covers what remains.
+#define PARTICLE_POOL_CHUNK 16384 // Particles per chunk of particle store memory (particles/ParticleStore.hpp).
+#define PARTICLE_POOL_FREE_CHUNKS 4 // Free chunks the particle store keeps for reuse before returning memory to the OS.
+#define PARTICLE_POOL_HUGE_PAGES 0 // Advise transparent huge pages for the particle store.
+#define NODE_CACHE_LIFETIME 64 // Timesteps a node may go unrequested before particle and flow ranks drop it from their node caches.
+#define MERGE_DIAMETER_TOLERANCE 0.05 // Parcels in a crowded cell merge when their diameters differ by at most this fraction,
+#define MERGE_VELOCITY_TOLERANCE 0.05 // and their velocities by at most this fraction of the faster one.
 
 
 typedef long long int int128_t;
@@ -144,6 +154,29 @@ namespace minicombust::utils
         T fuel          = 0.0;
     };
 
+    template <typename T> 
+    struct flow_cache_aos 
+    {
+        flow_aos<T> flow;
+        uint64_t    version; // Timestep the node was last requested or recieved
+    };
+
+    // Particle state needed to continue tracking on another rank. Interpolated flow values and source terms are recomputed each timestep.
+    template <typename T> 
+    struct particle_state_aos 
+    {
+        vec<T>   x1;
+        vec<T>   v1;
+        vec<T>   a1;
+        T        mass;
+        T        temp;
+        T        diameter;
+        T        age;
+        T        weight;
+        uint64_t cell;
+        uint64_t id;
+    };
+
     template <typename T>
     struct phi_vector
     {
@@ -153,6 +186,24 @@ namespace minicombust::utils
         T *P;
     };
 
+    template<typename T>
+    inline bool value_changed(const T old_value, const T new_value, const T tolerance)
+    {
+        // Relative difference. A negative tolerance marks every value as changed.
+        return fabs(new_value - old_value) > tolerance * fabs(old_value);
+    }
+
+    template<typename T>
+    inline bool flow_aos_changed(const flow_aos<T>& old_flow, const flow_aos<T>& new_flow, const T tolerance)
+    {
+        return value_changed(old_flow.vel.x,    new_flow.vel.x,    tolerance) || 
+               value_changed(old_flow.vel.y,    new_flow.vel.y,    tolerance) || 
+               value_changed(old_flow.vel.z,    new_flow.vel.z,    tolerance) || 
+               value_changed(old_flow.pressure, new_flow.pressure, tolerance) || 
+               value_changed(old_flow.temp,     new_flow.temp,     tolerance) ||
+               (tolerance < 0.0);
+    }
+
     template<typename T>
     inline bool vec_nequal(const vec<T> lhs, const vec<T> rhs)
     {
@@ -429,12 +480,41 @@ namespace minicombust::utils
         double sent_cells;
         double nodes_recieved;
         double useful_nodes_proportion;
+        double cached_nodes;
+        double evicted_nodes;         // Nodes dropped from the node cache after NODE_CACHE_LIFETIME timesteps unrequested
+        double coupling_raw_bytes;
+        double coupling_encoded_bytes;
+        double coupling_encode_time;
+        double coupling_decode_time;
+        double aggregated_cells;
+        double migrated_particles;
+        double global_migrations;     // Migrations exchanged with every particle rank rather than only neighbours
+        double rebalances;
+        double rebalanced_particles;
+        double sorts;
+        double sort_cost;
+        double presort_kernel_cost;   // Per particle, summed over the timesteps before each sort
+        double postsort_kernel_cost;  // Per particle, summed over the timesteps after each sort
+        double sort_saved_cost;
+        double subcycled_particles;   // Particle timesteps integrated in sub-steps
+        double spray_substeps;        // Sub-steps taken by those particles
+        double max_spray_substeps;
+        double emitted_droplets;      // Droplets represented by the emitted particles
+        double merged_particles;      // Parcels removed by merging into another parcel of their cell
+        double merged_cells;          // Cells over the particle cap when merging
+        double pool_chunks;           // Particle store chunks holding memory at the end of the run
+        double pool_peak_chunks;
     };
 
     struct Flow_Logger {
         double recieved_cells;
         double reduced_recieved_cells;
         double sent_nodes;
+        double cached_nodes;
+        double coupling_raw_bytes;
+        double coupling_encoded_bytes;
+        double coupling_encode_time;
+        double coupling_decode_time;
     };
 
     struct MPI_Config {
@@ -458,11 +538,20 @@ namespace minicombust::utils
         int node_world_size;
         MPI_Comm node_world;
 
+        // Particle ranks only. Particle ranks sharing a node, and one leader rank per node.
+        int particle_node_rank;
+        int particle_node_world_size;
+        MPI_Comm particle_node_world;
+        int particle_leader_rank;
+        int particle_leader_world_size;
+        MPI_Comm particle_leader_world;
+
         MPI_Win win_cells;
         MPI_Win win_cell_centers;
         MPI_Win win_cell_neighbours;
         MPI_Win win_points;
         MPI_Win win_cells_per_point;
+        MPI_Win win_cell_blocks;
         
         int solver_type;
         MPI_Datatype MPI_FLOW_STRUCTURE;
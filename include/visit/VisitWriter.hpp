@@ -5,6 +5,7 @@
 #include <string>
 
 #include "utils/utils.hpp"
+#include "particles/ParticleStore.hpp"
 #include "visit/vtkCellType.h"
 
 
@@ -170,7 +171,7 @@ namespace minicombust::visit
             }
 
 
-            void write_particles(string filename, int id, vector<Particle<T>>& particles)
+            void write_particles(string filename, int id, ParticleStore<T>& particles)
             {
                 // Print VTK Header
                 ofstream vtk_file;
@@ -254,7 +255,7 @@ namespace minicombust::visit
                 vtk_file << endl << "POINTS " << particles.size() << " float"  << endl;
                 for (uint64_t p = 0; p < particles.size(); p++)
                 {
-                    vtk_file << print_vec(particles[p].x1) << endl;
+                    vtk_file << print_vec(particles.x1.get(p)) << endl;
                 }
                 vtk_file << endl;
 
@@ -282,7 +283,7 @@ namespace minicombust::visit
                 vtk_file << "LOOKUP_TABLE default" << endl;
                 for(uint64_t p = 0; p < particles.size(); p++)
                 {
-                    vtk_file << particles[p].temp << "\t";
+                    vtk_file << particles.temp[p] << "\t";
                 } 
                 vtk_file << endl;
 
@@ -290,14 +291,14 @@ namespace minicombust::visit
                 // vtk_file << "LOOKUP_TABLE default" << endl;
                 // for(uint64_t p = 0; p < particles.size(); p++)
                 // {
-                //     vtk_file << particles[p].mass << "\t";
+                //     vtk_file << particles.mass[p] << "\t";
                 // } 
                 // vtk_file << endl;
 
                 // vtk_file << "VECTORS velocity float" << endl;
                 // for(uint64_t p = 0; p < particles.size(); p++)
                 // {
-                //     vtk_file << print_vec(particles[p].v1) << "\t";
+                //     vtk_file << print_vec(particles.v1.get(p)) << "\t";
                 // } 
                 // vtk_file << endl;
 
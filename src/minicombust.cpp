@@ -16,11 +16,48 @@ using namespace minicombust::flow;
 using namespace minicombust::particles;
 using namespace minicombust::visit;
 
+// Sends items[i] to world rank owners[i]. Returns the number of items recieved, in rank order, in a malloc'd *recieved.
+template<typename T>
+static uint64_t exchange_items(const T *items, const int *owners, uint64_t size, T **recieved, MPI_Datatype datatype, MPI_Comm world)
+{
+    int ranks;
+    MPI_Comm_size(world, &ranks);
+
+    int send_counts[ranks], recv_counts[ranks], send_displs[ranks], recv_displs[ranks], offsets[ranks];
+    for ( int r = 0; r < ranks; r++ )
+        send_counts[r] = 0;
+    for ( uint64_t i = 0; i < size; i++ )
+        send_counts[owners[i]]++;
+
+    send_displs[0] = 0;
+    for ( int r = 1; r < ranks; r++ )
+        send_displs[r] = send_displs[r - 1] + send_counts[r - 1];
+    for ( int r = 0; r < ranks; r++ )
+        offsets[r] = send_displs[r];
+
+    T *send_items = (T *)malloc(max(size, (uint64_t)1) * sizeof(T));
+    for ( uint64_t i = 0; i < size; i++ )
+        send_items[offsets[owners[i]]++] = items[i];
+
+    MPI_Alltoall(send_counts, 1, MPI_INT, recv_counts, 1, MPI_INT, world);
+
+    recv_displs[0] = 0;
+    for ( int r = 1; r < ranks; r++ )
+        recv_displs[r] = recv_displs[r - 1] + recv_counts[r - 1];
+    const uint64_t recv_size = recv_displs[ranks - 1] + recv_counts[ranks - 1];
+
+    *recieved = (T *)malloc(max(recv_size, (uint64_t)1) * sizeof(T));
+    MPI_Alltoallv(send_items, send_counts, send_displs, datatype, *recieved, recv_counts, recv_displs, datatype, world);
+
+    free(send_items);
+    return recv_size;
+}
+
 int main (int argc, char ** argv)
 {
     // MPI Initialisation 
     MPI_Init(NULL, NULL);
-    MPI_Config mpi_config;
+    MPI_Config mpi_config = {};
 
     mpi_config.world = MPI_COMM_WORLD;
 
@@ -31,11 +68,43 @@ int main (int argc, char ** argv)
     int particle_ranks = atoi(argv[1]);
     int flow_ranks     = mpi_config.world_size - particle_ranks;
 
-    // If rank < given number of particle ranks.
-    mpi_config.solver_type = (mpi_config.rank < particle_ranks); // 1 for particle, 0 for flow
-    MPI_Comm_split(mpi_config.world, mpi_config.solver_type, mpi_config.rank, &mpi_config.particle_flow_world);
-    MPI_Comm_rank(mpi_config.particle_flow_world,  &mpi_config.particle_flow_rank);
-    MPI_Comm_size(mpi_config.particle_flow_world,  &mpi_config.particle_flow_world_size);
+    // Split world into particle and flow ranks, again each time the ranks are re-split.
+    auto split_world = [&] ()
+    {
+        // If rank < given number of particle ranks.
+        mpi_config.solver_type = (mpi_config.rank < particle_ranks); // 1 for particle, 0 for flow
+        MPI_Comm_split(mpi_config.world, mpi_config.solver_type, mpi_config.rank, &mpi_config.particle_flow_world);
+        MPI_Comm_rank(mpi_config.particle_flow_world,  &mpi_config.particle_flow_rank);
+        MPI_Comm_size(mpi_config.particle_flow_world,  &mpi_config.particle_flow_world_size);
+
+        // Create node-local and node leader particle worlds, used to pre-aggregate particle source terms.
+        mpi_config.particle_node_world        = MPI_COMM_NULL;
+        mpi_config.particle_leader_world      = MPI_COMM_NULL;
+        mpi_config.particle_leader_rank       = -1;
+        mpi_config.particle_leader_world_size = 0;
+        if ( mpi_config.solver_type == PARTICLE )
+        {
+            MPI_Comm_split_type(mpi_config.particle_flow_world, MPI_COMM_TYPE_SHARED, mpi_config.particle_flow_rank, MPI_INFO_NULL, &mpi_config.particle_node_world);
+            MPI_Comm_rank(mpi_config.particle_node_world,  &mpi_config.particle_node_rank);
+            MPI_Comm_size(mpi_config.particle_node_world,  &mpi_config.particle_node_world_size);
+
+            MPI_Comm_split(mpi_config.particle_flow_world, (mpi_config.particle_node_rank == 0) ? 0 : MPI_UNDEFINED, mpi_config.particle_flow_rank, &mpi_config.particle_leader_world);
+            if ( mpi_config.particle_leader_world != MPI_COMM_NULL )
+            {
+                MPI_Comm_rank(mpi_config.particle_leader_world,  &mpi_config.particle_leader_rank);
+                MPI_Comm_size(mpi_config.particle_leader_world,  &mpi_config.particle_leader_world_size);
+            }
+        }
+
+        mpi_config.one_flow_rank             = (int *)     realloc(mpi_config.one_flow_rank,             flow_ranks * sizeof(int));
+        mpi_config.every_one_flow_rank       = (int *)     realloc(mpi_config.every_one_flow_rank,       flow_ranks * sizeof(int));
+        mpi_config.one_flow_world_size       = (int *)     realloc(mpi_config.one_flow_world_size,       flow_ranks * sizeof(int));
+        mpi_config.every_one_flow_world_size = (int *)     realloc(mpi_config.every_one_flow_world_size, flow_ranks * sizeof(int));
+        mpi_config.one_flow_world            = (MPI_Comm *)realloc(mpi_config.one_flow_world,            flow_ranks * sizeof(MPI_Comm));
+        mpi_config.every_one_flow_world      = (MPI_Comm *)realloc(mpi_config.every_one_flow_world,      flow_ranks * sizeof(MPI_Comm));
+        mpi_config.alias_rank                = (int *)     realloc(mpi_config.alias_rank,                flow_ranks * sizeof(int));
+    };
+    split_world();
     
     // Create Flow/Particle Datatypes
     MPI_Type_contiguous(sizeof(flow_aos<double>)/sizeof(double),     MPI_DOUBLE, &mpi_config.MPI_FLOW_STRUCTURE);
@@ -48,9 +117,27 @@ int main (int argc, char ** argv)
 
     // Run Configuration
     const uint64_t ntimesteps                   = 1500;
-    const double   delta                        = 1.0e-8;
     const int64_t output_iteration              = (argc > 4) ? atoi(argv[4]) : 10;
     const uint64_t particles_per_timestep       = (argc > 2) ? atoi(argv[2]) : 10;
+    const CODEC_MODE coupling_codec             = (argc > 5) ? (CODEC_MODE)atoi(argv[5]) : CODEC_NONE; // Coupling message encoding, see CouplingCodec.hpp.
+    const double   coupling_codec_tolerance     = (argc > 6) ? atof(argv[6])             : 1.0e-4;     // CODEC_QUANTISED error, as a fraction of each field's range.
+    const bool     aggregate_source_terms       = (argc > 7) ? atoi(argv[7])             : false;      // Sum particle source terms across particle ranks before sending to flow.
+    const bool     decompose_particles          = (argc > 8) ? atoi(argv[8])             : false;      // Each particle rank owns the particles inside a range of flow blocks.
+    const uint64_t rebalance_frequency          = (argc > 9) ? atoi(argv[9])             : 0;          // Timesteps between particle load balancing checks (0 disables).
+    const double   rebalance_hysteresis         = (argc > 10) ? atof(argv[10])           : 0.1;        // Rebalance when the slowest particle rank exceeds the mean kernel time by this fraction.
+    const uint64_t split_frequency              = (argc > 11) ? atoi(argv[11])           : 0;          // Timesteps between particle/flow split measurements (0 disables).
+    const CELL_LOCATOR cell_locator             = (argc > 12) ? (CELL_LOCATOR)atoi(argv[12]) : LOCATE_WALK; // Particle cell search, see Mesh.hpp.
+    const uint64_t sort_frequency               = (argc > 13) ? atoi(argv[13])           : 0;          // Minimum timesteps between sorting particles by cell (0 disables).
+    const INTERPOLATION interpolation           = (argc > 14) ? (INTERPOLATION)atoi(argv[14]) : INTERPOLATE_INVERSE_DISTANCE; // Node to particle interpolation, see ParticleSolver.hpp.
+    const FUEL_PROPERTIES fuel_properties_mode  = (argc > 15) ? (FUEL_PROPERTIES)atoi(argv[15]) : FUEL_PROPERTIES_EXACT; // Fuel property evaluation in the spray kernel, see FuelPropertyTable.hpp.
+    const double   delta                        = (argc > 16) ? atof(argv[16])           : 1.0e-8;     // Timestep (s) of the flow solver, particle solver and coupling.
+    const double   subcycle_tolerance           = (argc > 17) ? atof(argv[17])           : 0.1;        // Largest relative change of a droplet per spray step before it sub-cycles (0 disables).
+    const double   injection_mass_flow          = (argc > 18) ? atof(argv[18])           : 0.0;        // Fuel mass flow (kg/s) of the injector, spread over the emitted particles as parcels (0 emits one droplet per particle).
+    const uint64_t merge_frequency              = (argc > 19) ? atoi(argv[19])           : 0;          // Timesteps between merging parcels in crowded cells (0 disables).
+    const uint64_t max_cell_particles           = (argc > 20) ? max(atoi(argv[20]), 1)   : 64;         // Particles a cell may hold before its parcels are merged.
+    const uint64_t particle_threads             = (argc > 21) ? max(atoi(argv[21]), 1)   : 1;          // Threads per particle rank running the particle kernels.
+    const double   node_cache_tolerance         = (argc > 22) ? atof(argv[22])           : 0.0;        // Relative change before a cached node is resent to a particle rank (negative resends every node).
+    const bool     resplit                      = (argc > 23) ? atoi(argv[23])           : false;      // Re-split world to the measured particle/flow split at each split measurement.
     
     // Mesh Configuration
     const uint64_t modifier                = (argc > 3) ? atoi(argv[3]) : 10;
@@ -65,42 +152,168 @@ int main (int argc, char ** argv)
 
     // Performance
     double mesh_time = 0., setup_time = 0., program_time = 0., output_time = 0.;
+    double step_time = 0., split_coupling_time = 0.;
+    int    recommended_particle_ranks = particle_ranks, new_particle_ranks = particle_ranks;
+    uint64_t resplits = 0;
 
     // Perform setup and benchmark cases
     MPI_Barrier(mpi_config.world); setup_time  -= MPI_Wtime(); mesh_time  -= MPI_Wtime(); 
     Mesh<double> *mesh                          = load_mesh(&mpi_config, box_dim, elements_per_dim, flow_ranks);
+    mesh->select_cell_locator(cell_locator);
     MPI_Barrier(mpi_config.world); mesh_time   += MPI_Wtime();
 
 
 
-    mpi_config.one_flow_rank             = (int *)     malloc(flow_ranks * sizeof(int));
-    mpi_config.every_one_flow_rank       = (int *)     malloc(flow_ranks * sizeof(int));
-    mpi_config.one_flow_world_size       = (int *)     malloc(flow_ranks * sizeof(int));
-    mpi_config.every_one_flow_world_size = (int *)     malloc(flow_ranks * sizeof(int));
-    mpi_config.one_flow_world            = (MPI_Comm *)malloc(flow_ranks * sizeof(MPI_Comm));
-    mpi_config.every_one_flow_world      = (MPI_Comm *)malloc(flow_ranks * sizeof(MPI_Comm));
-    mpi_config.alias_rank                = (int *)     malloc(flow_ranks * sizeof(int));
-
     MPI_Barrier(mpi_config.world);
 
     //Setup solvers
-    ParticleSolver<double> *particle_solver = nullptr;
-    FlowSolver<double>     *flow_solver     = nullptr;
-    if (mpi_config.solver_type == PARTICLE)
+    ParticleSolver<double>       *particle_solver = nullptr;
+    ParticleDistribution<double> *particle_dist   = nullptr;
+    FlowSolver<double>           *flow_solver     = nullptr;
+    auto setup_solvers = [&] ()
     {
-        uint64_t       local_particles_per_timestep   = particles_per_timestep / mpi_config.particle_flow_world_size;
-        int            remainder_particles            = particles_per_timestep % mpi_config.particle_flow_world_size;
+        if (mpi_config.solver_type == PARTICLE)
+        {
+            uint64_t       local_particles_per_timestep   = particles_per_timestep / mpi_config.particle_flow_world_size;
+            int            remainder_particles            = particles_per_timestep % mpi_config.particle_flow_world_size;
 
-        const uint64_t reserve_particles_size         = 2 * (local_particles_per_timestep + 1) * ntimesteps;
+            particle_dist = load_injector_particle_distribution(particles_per_timestep, local_particles_per_timestep, remainder_particles, &mpi_config, mesh);
+            // particle_dist = load_particle_distribution(particles_per_timestep, local_particles_per_timestep, remainder_particles, &mpi_config, mesh);
+            if ( injection_mass_flow > 0. )  particle_dist->set_mass_flow(injection_mass_flow, delta);
+            particle_solver = new ParticleSolver<double>(&mpi_config, ntimesteps, delta, particle_dist, mesh, coupling_codec, coupling_codec_tolerance, aggregate_source_terms, decompose_particles, rebalance_frequency, rebalance_hysteresis, sort_frequency, interpolation, fuel_properties_mode, subcycle_tolerance, merge_frequency, max_cell_particles, particle_threads); 
+        }
+        else
+        {
+            flow_solver     = new FlowSolver<double>(&mpi_config, mesh, delta, node_cache_tolerance, coupling_codec, coupling_codec_tolerance);
+        }
+    };
+    setup_solvers();
 
-        ParticleDistribution<double> *particle_dist = load_injector_particle_distribution(particles_per_timestep, local_particles_per_timestep, remainder_particles, &mpi_config, mesh);
-        // ParticleDistribution<double> *particle_dist = load_particle_distribution(particles_per_timestep, local_particles_per_timestep, remainder_particles, &mpi_config, mesh);
-        particle_solver = new ParticleSolver<double>(&mpi_config, ntimesteps, delta, particle_dist, mesh, reserve_particles_size); 
-    }
-    else
+    // Re-split world into new_particle_ranks particle ranks and flow ranks after timestep, rebuilding the mesh blocks for the new
+    // flow ranks. Cell fields move to the flow rank owning their cell in the new mesh, and particles to the new particle ranks,
+    // where decomposed particles migrate to the owners of their blocks. Counters are added to a rank of the same group.
+    auto resplit_ranks = [&] (int new_particle_ranks, uint64_t timestep)
     {
-        flow_solver     = new FlowSolver<double>(&mpi_config, mesh, delta);
-    }
+        const int old_particle_ranks     = particle_ranks;
+        const int old_solver_type        = mpi_config.solver_type;
+        const int old_particle_flow_rank = mpi_config.particle_flow_rank;
+
+        vector<Particle<double>> particles;
+        vector<vec<double>>      cell_centres;
+        vector<flow_aos<double>> cell_flows;
+        Particle_Logger          particle_logger = {};
+        Flow_Logger              flow_logger     = {};
+        if (mpi_config.solver_type == PARTICLE)
+        {
+            particle_solver->export_particles(particles);
+            particle_logger = particle_solver->get_logger();
+            delete particle_solver;
+            delete particle_dist;
+            particle_solver = nullptr;
+            particle_dist   = nullptr;
+        }
+        else
+        {
+            flow_solver->export_cell_flow(cell_centres, cell_flows);
+            flow_logger = flow_solver->get_logger();
+            delete flow_solver;
+            flow_solver = nullptr;
+        }
+
+        // The old mesh is read until everything has moved, then its windows and the old worlds are freed.
+        Mesh<double> *old_mesh   = mesh;
+        MPI_Config    old_config = mpi_config;
+
+        particle_ranks = new_particle_ranks;
+        flow_ranks     = mpi_config.world_size - particle_ranks;
+        split_world();
+        mesh = load_mesh(&mpi_config, box_dim, elements_per_dim, flow_ranks);
+        mesh->select_cell_locator(cell_locator);
+
+        // Cell fields go to the flow rank owning the new cell at the same centre.
+        vector<uint64_t> cells(cell_centres.size());
+        vector<int>      cell_owners(cell_centres.size());
+        for ( uint64_t i = 0; i < cell_centres.size(); i++ )
+        {
+            cells[i]       = mesh->locate_structured(cell_centres[i]);
+            cell_owners[i] = particle_ranks + mesh->get_block_id(cells[i]);
+        }
+
+        uint64_t         *recieved_cells;
+        flow_aos<double> *recieved_flows;
+        const uint64_t recieved_cells_size = exchange_items(cells.data(),      cell_owners.data(), cells.size(), &recieved_cells, MPI_UINT64_T,                  mpi_config.world);
+        exchange_items(cell_flows.data(), cell_owners.data(), cells.size(), &recieved_flows, mpi_config.MPI_FLOW_STRUCTURE, mpi_config.world);
+
+        // Particles are located in the new mesh, falling back to their old cell's centre if their position rounds outside it,
+        // and dealt out over the new particle ranks.
+        vector<int> particle_owners(particles.size());
+        for ( uint64_t p = 0; p < particles.size(); p++ )
+        {
+            const uint64_t old_cell = particles[p].cell;
+
+            particles[p].cell = mesh->locate_structured(particles[p].x1);
+            if ( particles[p].cell == MESH_BOUNDARY )
+                particles[p].cell = mesh->locate_structured(old_mesh->cell_centers[old_cell - old_mesh->shmem_cell_disp]);
+
+            particle_owners[p] = (old_particle_flow_rank + p) % particle_ranks;
+        }
+
+        MPI_Datatype MPI_RESPLIT_PARTICLE;
+        MPI_Type_contiguous(sizeof(Particle<double>), MPI_BYTE, &MPI_RESPLIT_PARTICLE);
+        MPI_Type_commit(&MPI_RESPLIT_PARTICLE);
+
+        Particle<double> *recieved_particles;
+        const uint64_t recieved_particles_size = exchange_items(particles.data(), particle_owners.data(), particles.size(), &recieved_particles, MPI_RESPLIT_PARTICLE, mpi_config.world);
+        MPI_Type_free(&MPI_RESPLIT_PARTICLE);
+
+        // Old particle rank r adds its counters to new particle rank r % particle_ranks, and flow ranks likewise.
+        Particle_Logger particle_loggers[mpi_config.world_size];
+        Flow_Logger     flow_loggers[mpi_config.world_size];
+        MPI_Allgather(&particle_logger, sizeof(Particle_Logger), MPI_BYTE, particle_loggers, sizeof(Particle_Logger), MPI_BYTE, mpi_config.world);
+        MPI_Allgather(&flow_logger,     sizeof(Flow_Logger),     MPI_BYTE, flow_loggers,     sizeof(Flow_Logger),     MPI_BYTE, mpi_config.world);
+
+        setup_solvers();
+        if (mpi_config.solver_type == PARTICLE)
+        {
+            for ( int r = 0; r < old_particle_ranks; r++ )
+            {
+                if ( r % particle_ranks == mpi_config.particle_flow_rank )
+                    particle_solver->add_logger(particle_loggers[r]);
+            }
+            particle_solver->set_timestep_count(timestep);
+            particle_solver->import_particles(recieved_particles, recieved_particles_size);
+        }
+        else
+        {
+            for ( int r = old_particle_ranks; r < mpi_config.world_size; r++ )
+            {
+                if ( (r - old_particle_ranks) % flow_ranks == mpi_config.particle_flow_rank )
+                    flow_solver->add_logger(flow_loggers[r]);
+            }
+            flow_solver->set_timestep_count(timestep);
+            flow_solver->import_cell_flow(recieved_cells, recieved_flows, recieved_cells_size);
+        }
+
+        free(recieved_cells);
+        free(recieved_flows);
+        free(recieved_particles);
+
+        MPI_Win_free(&old_config.win_cells);
+        MPI_Win_free(&old_config.win_cell_neighbours);
+        MPI_Win_free(&old_config.win_points);
+        MPI_Win_free(&old_config.win_cells_per_point);
+        MPI_Win_free(&old_config.win_cell_centers);
+        if ( old_mesh->cell_blocks != nullptr )  MPI_Win_free(&old_config.win_cell_blocks);
+        delete old_mesh;
+
+        MPI_Comm_free(&old_config.node_world);
+        MPI_Comm_free(&old_config.particle_flow_world);
+        if ( old_solver_type == PARTICLE )
+        {
+            MPI_Comm_free(&old_config.particle_node_world);
+            if ( old_config.particle_leader_world != MPI_COMM_NULL )  MPI_Comm_free(&old_config.particle_leader_world);
+        }
+    };
 
     if (mpi_config.rank == 0)   cout << endl;
     setup_time += MPI_Wtime(); MPI_Barrier(mpi_config.world); 
@@ -124,6 +337,8 @@ int main (int argc, char ** argv)
 
     for(uint64_t t = 0; t < ntimesteps; t++)
     {
+        step_time -= MPI_Wtime();
+
         if (mpi_config.solver_type == PARTICLE)
         {
             particle_solver->timestep();
@@ -138,12 +353,56 @@ int main (int argc, char ** argv)
         else
             flow_solver->timestep();
 
-        
-        
+        step_time += MPI_Wtime();
+
+        // Compare the work of each group outside the coupling exchange, the group with less work idles in the exchange.
+        if ( split_frequency && ((t + 1) % split_frequency) == 0 )
+        {
+            const double coupling_time = (mpi_config.solver_type == PARTICLE) ? particle_solver->get_coupling_time() : flow_solver->get_coupling_time();
+            const double compute_time  = step_time - (coupling_time - split_coupling_time);
+            split_coupling_time = coupling_time;
+            step_time           = 0.;
+
+            double local_work[2] = { (mpi_config.solver_type == PARTICLE) ? compute_time : 0., (mpi_config.solver_type == FLOW) ? compute_time : 0. };
+            double group_work[2];
+            MPI_Reduce(local_work, group_work, 2, MPI_DOUBLE, MPI_SUM, 0, mpi_config.world);
+
+            if ( mpi_config.rank == 0 )
+            {
+                // Assuming each group scales linearly, the step time is max(Wp/P, Wf/F), balanced when P/F = Wp/Wf.
+                const double particle_step = group_work[0] / particle_ranks;
+                const double flow_step     = group_work[1] / flow_ranks;
+                const double idle          = 1. - min(particle_step, flow_step) / max(particle_step, flow_step);
+
+                recommended_particle_ranks = (int)round(mpi_config.world_size * group_work[0] / (group_work[0] + group_work[1]));
+                recommended_particle_ranks = max(1, min(mpi_config.world_size - 1, recommended_particle_ranks));
+
+                printf("Timestep %6lu Split compute (PARTICLE %7.3fs) (FLOW %7.3fs) idle %5.1f%% in %s ranks, balanced split %d particle / %d flow ranks\n", t + 1, particle_step, flow_step, 100. * idle,
+                       (particle_step < flow_step) ? "particle" : "flow", recommended_particle_ranks, mpi_config.world_size - recommended_particle_ranks);
+
+                // Re-splitting rebuilds the mesh and solvers, only do it if the predicted step time drops by more than the hysteresis.
+                const double resplit_step = max(group_work[0] / recommended_particle_ranks, group_work[1] / (mpi_config.world_size - recommended_particle_ranks));
+                new_particle_ranks        = ( resplit && (1. + rebalance_hysteresis) * resplit_step < max(particle_step, flow_step) ) ? recommended_particle_ranks : particle_ranks;
+            }
+
+            MPI_Bcast(&new_particle_ranks, 1, MPI_INT, 0, mpi_config.world);
+            if ( new_particle_ranks != particle_ranks )
+            {
+                double resplit_time = -MPI_Wtime();
+                resplit_ranks(new_particle_ranks, t + 1);
+                resplit_time += MPI_Wtime();
+
+                resplits++;
+                split_coupling_time = 0.;
+                if ( mpi_config.rank == 0 )  printf("Timestep %6lu Re-split to %d particle / %d flow ranks in %.2fs\n", t + 1, particle_ranks, flow_ranks, resplit_time);
+            }
+        }
     }
     program_time += MPI_Wtime();
     MPI_Barrier(mpi_config.world);
     if (mpi_config.rank == 0) printf("Done!\n\n");
+    if (mpi_config.rank == 0 && split_frequency && !resplit) printf("Measured particle/flow split: rerun with %d particle ranks (currently %d).\n\n", recommended_particle_ranks, particle_ranks);
+    if (mpi_config.rank == 0 && split_frequency &&  resplit) printf("Re-split %lu times, finishing with %d particle / %d flow ranks.\n\n", resplits, particle_ranks, flow_ranks);
 
     //Print logger stats and write performance counters
     if (LOGGER) 
@@ -0,0 +1,157 @@
+#include "utils/CouplingCodec.hpp"
+#include "utils/CounterRNG.hpp"
+
+#include "tests/catch.hpp"
+
+using namespace std;
+
+using namespace minicombust::utils;
+
+
+// Ids and fields of one coupling message, in the order they were encoded.
+struct codec_message
+{
+    vector<uint64_t>         ids;
+    vector<flow_aos<double>> fields;
+};
+
+static codec_message make_message(const vector<uint64_t>& ids, uint64_t seed)
+{
+    codec_message message = { ids, {} };
+    for ( uint64_t i = 0; i < ids.size(); i++ )
+    {
+        double r[5];
+        for ( uint64_t c = 0; c < 5; c++ )  r[c] = counter_uniform(seed, 0, i, 0, c);
+        message.fields.push_back({ {100. * r[0] - 50., 1e-3 * r[1], -7. * r[2]}, 4000. + 1e3 * r[3], 300. + 1700. * r[4] });
+    }
+    return message;
+}
+
+// Encodes and decodes message, checking the size bound. Returns the decoded message.
+static codec_message round_trip(CouplingCodec<double>& codec, const codec_message& message)
+{
+    uint8_t *buffer;
+    const size_t bytes = codec.encode(0, message.ids.data(), message.fields.data(), message.ids.size(), &buffer);
+    REQUIRE( bytes <= codec.max_encoded_size<flow_aos<double>>(message.ids.size()) );
+
+    codec_message decoded;
+    decoded.ids.resize(codec.decode_size(buffer));
+    decoded.fields.resize(decoded.ids.size());
+    REQUIRE( codec.decode(buffer, decoded.ids.data(), decoded.fields.data()) == message.ids.size() );
+    return decoded;
+}
+
+// Decoded ids are sorted, so the original message is sorted by id to compare. Pairs with the same id may come in any order,
+// so each decoded pair is matched against the input pairs with that id.
+template<typename Match>
+static void require_same_pairs(const codec_message& message, const codec_message& decoded, Match match)
+{
+    REQUIRE( decoded.ids.size() == message.ids.size() );
+    REQUIRE( is_sorted(decoded.ids.begin(), decoded.ids.end()) );
+
+    vector<uint64_t> sorted_ids = message.ids;
+    sort(sorted_ids.begin(), sorted_ids.end());
+    REQUIRE( decoded.ids == sorted_ids );
+
+    vector<bool> used(message.ids.size(), false);
+    for ( uint64_t i = 0; i < decoded.ids.size(); i++ )
+    {
+        bool found = false;
+        for ( uint64_t j = 0; j < message.ids.size() && !found; j++ )
+        {
+            if ( used[j] || message.ids[j] != decoded.ids[i] || !match(message.fields[j], decoded.fields[i]) )  continue;
+            used[j] = found = true;
+        }
+        REQUIRE( found );
+    }
+}
+
+static const vector<vector<uint64_t>> codec_id_sets =
+{
+    { },
+    { 7 },
+    { 5, 3, 9, 1, 0, 8 },                                              // Unsorted
+    { 4, 4, 2, 4, 2, 2, 9 },                                           // Duplicates
+    { 0, 1ULL << 20, 3, 1ULL << 40, UINT64_MAX - 1, 1ULL << 63, 17 },  // Large gaps, up to 10 byte varints
+};
+
+TEST_CASE( "Lossless coupling codec returns the exact bits.", "[codec]" ) {
+
+    CouplingCodec<double> codec(CODEC_LOSSLESS, 0.0);
+
+    for ( uint64_t s = 0; s < codec_id_sets.size(); s++ )
+    {
+        const codec_message message = make_message(codec_id_sets[s], s);
+        const codec_message decoded = round_trip(codec, message);
+
+        require_same_pairs(message, decoded, [] (const flow_aos<double>& a, const flow_aos<double>& b) { return memcmp(&a, &b, sizeof(flow_aos<double>)) == 0; });
+    }
+}
+
+TEST_CASE( "Quantised coupling codec error is at most tolerance times the range.", "[codec]" ) {
+
+    for ( const double tolerance : { 1e-2, 1e-4, 1e-7 } )
+    {
+        CouplingCodec<double> codec(CODEC_QUANTISED, tolerance);
+
+        for ( uint64_t s = 0; s < codec_id_sets.size(); s++ )
+        {
+            const codec_message message = make_message(codec_id_sets[s], s);
+            const codec_message decoded = round_trip(codec, message);
+
+            // Range of each field component over the message.
+            double low[5], high[5];
+            for ( uint64_t c = 0; c < 5; c++ )
+            {
+                low[c]  =  __DBL_MAX__;
+                high[c] = -__DBL_MAX__;
+                for ( const flow_aos<double>& field : message.fields )
+                {
+                    low[c]  = min(low[c],  ((const double *)&field)[c]);
+                    high[c] = max(high[c], ((const double *)&field)[c]);
+                }
+            }
+
+            // Rounding min + q * step leaves a few ulps on top of the quantisation error.
+            require_same_pairs(message, decoded, [&] (const flow_aos<double>& a, const flow_aos<double>& b) {
+                for ( uint64_t c = 0; c < 5; c++ )
+                {
+                    const double value = ((const double *)&a)[c];
+                    if ( fabs(value - ((const double *)&b)[c]) > tolerance * (high[c] - low[c]) + 1e-14 * fabs(value) )  return false;
+                }
+                return true;
+            });
+        }
+    }
+
+    SECTION( "Zero range fields are exact." ) {
+        CouplingCodec<double> codec(CODEC_QUANTISED, 1e-3);
+
+        codec_message message = make_message({ 3, 1, 2, 1 }, 0);
+        for ( flow_aos<double>& field : message.fields )  field.pressure = 4000.25;
+
+        const codec_message decoded = round_trip(codec, message);
+        for ( const flow_aos<double>& field : decoded.fields )
+            REQUIRE( field.pressure == 4000.25 );
+    }
+}
+
+TEST_CASE( "Encoded messages fit in max_encoded_size.", "[codec]" ) {
+
+    // Worst case: 10 byte id deltas and full range values quantised to the most steps.
+    vector<uint64_t> ids;
+    for ( uint64_t i = 0; i < 64; i++ )  ids.push_back((i % 2) ? UINT64_MAX - i : i);
+
+    for ( const CODEC_MODE mode : { CODEC_LOSSLESS, CODEC_FLOAT32, CODEC_QUANTISED } )
+    {
+        CouplingCodec<double> codec(mode, 1e-15);
+
+        codec_message message = make_message(ids, 1);
+        message.fields[0].temp = -1e300;
+        message.fields[1].temp =  1e300;
+
+        uint8_t *buffer;
+        for ( uint64_t elements = 0; elements <= ids.size(); elements += 8 )
+            REQUIRE( codec.encode(0, message.ids.data(), message.fields.data(), elements, &buffer) <= codec.max_encoded_size<flow_aos<double>>(elements) );
+    }
+}
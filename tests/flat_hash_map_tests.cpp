@@ -0,0 +1,174 @@
+#include <unordered_map>
+#include <set>
+
+#include "utils/FlatHashMap.hpp"
+
+#include "tests/catch.hpp"
+
+using namespace std;
+
+using namespace minicombust::utils;
+
+
+// Same hash and tag as FlatHashMap, to build keys that collide on purpose.
+static inline uint64_t test_hash(uint64_t key)     { return key * 0x9E3779B97F4A7C15ULL; }
+static inline uint8_t  test_tag(uint64_t key)      { return 0x80 | ((test_hash(key) >> 32) & 0x7f); }
+static inline uint64_t test_group(uint64_t key)    { return test_hash(key) >> 63; } // Group in a two group table
+
+TEST_CASE( "FlatHashMap inserts, finds and erases across rehashes.", "[flat_hash_map]" ) {
+
+    FlatHashMap<uint64_t, uint64_t>    map;
+    unordered_map<uint64_t, uint64_t>  reference;
+
+    // Grows from empty through several rehashes, erasing every third key on the way.
+    for ( uint64_t i = 0; i < 5000; i++ )
+    {
+        const uint64_t key = i * 7919 + 13;
+        map[key]       = i;
+        reference[key] = i;
+
+        if ( i % 3 == 0 )
+        {
+            const uint64_t erase_key = (i / 2) * 7919 + 13;
+            REQUIRE( map.erase(erase_key) == reference.erase(erase_key) );
+        }
+    }
+
+    REQUIRE( map.size() == reference.size() );
+    for ( uint64_t i = 0; i < 5000; i++ )
+    {
+        const uint64_t key = i * 7919 + 13;
+        REQUIRE( map.count(key) == reference.count(key) );
+        if ( reference.count(key) )
+        {
+            REQUIRE( map.find(key) != nullptr );
+            REQUIRE( *map.find(key) == reference[key] );
+        }
+        else
+        {
+            REQUIRE( map.find(key) == nullptr );
+        }
+    }
+    REQUIRE( map.erase(1) == 0 );
+}
+
+TEST_CASE( "FlatHashMap reuses deleted slots.", "[flat_hash_map]" ) {
+
+    FlatHashMap<uint64_t, uint64_t> map;
+    map.reserve(1000);
+    for ( uint64_t key = 0; key < 1000; key++ )  map[key] = key;
+
+    const size_t memory = map.get_memory_usage();
+
+    // Churning keys leaves deleted slots behind. Inserts reuse them, and mostly deleted tables are rehashed in place, so
+    // the table never grows.
+    for ( uint64_t round = 1; round <= 50; round++ )
+    {
+        for ( uint64_t key = 0; key < 1000; key++ )
+        {
+            REQUIRE( map.erase((round - 1) * 1000 + key) == 1 );
+            map[round * 1000 + key] = key;
+        }
+        REQUIRE( map.size() == 1000 );
+        REQUIRE( map.get_memory_usage() == memory );
+    }
+
+    for ( uint64_t key = 0; key < 1000; key++ )
+    {
+        REQUIRE( map.count(49 * 1000 + key) == 0 );
+        REQUIRE( *map.find(50 * 1000 + key) == key );
+    }
+}
+
+TEST_CASE( "FlatHashMap iterates only the keys inserted since clear().", "[flat_hash_map]" ) {
+
+    FlatHashMap<uint64_t, uint64_t> map;
+    for ( uint64_t key = 0; key < 300; key++ )  map[key] = key;
+
+    map.clear();
+    REQUIRE( map.size() == 0 );
+    REQUIRE( map.begin() == map.end() );
+
+    set<uint64_t> inserted;
+    for ( uint64_t key = 1000; key < 1100; key += 3 )
+    {
+        map[key] = 2 * key;
+        inserted.insert(key);
+    }
+
+    set<uint64_t> iterated;
+    for ( auto& slot : map )
+    {
+        REQUIRE( slot.second == 2 * slot.first );
+        iterated.insert(slot.first);
+    }
+    REQUIRE( iterated == inserted );
+
+    for ( uint64_t key = 0; key < 300; key++ )
+        REQUIRE( map.count(key) == 0 );
+}
+
+TEST_CASE( "FlatHashMap clear() survives the generation wrapping around.", "[flat_hash_map]" ) {
+
+    FlatHashMap<uint64_t, uint64_t> map;
+    for ( uint64_t key = 0; key < 100; key++ )  map[key] = key;
+
+    // 2^32 clears take the generation back past zero, where the group generations are reset.
+    for ( uint64_t i = 0; i < (1ULL << 32); i++ )
+        map.clear();
+
+    REQUIRE( map.size() == 0 );
+    REQUIRE( map.begin() == map.end() );
+    for ( uint64_t key = 0; key < 100; key++ )
+        REQUIRE( map.find(key) == nullptr );
+
+    for ( uint64_t key = 50; key < 150; key++ )  map[key] = key + 1;
+
+    uint64_t iterated = 0;
+    for ( auto& slot : map )
+    {
+        REQUIRE( slot.second == slot.first + 1 );
+        iterated++;
+    }
+    REQUIRE( iterated == 100 );
+    REQUIRE( map.count(49) == 0 );
+}
+
+TEST_CASE( "FlatHashMap confirms SWAR tag matches by key.", "[flat_hash_map]" ) {
+
+    // Keys in group 0 of a two group table: a pair of keys with the same tag, and a key whose tag is one bit away, which the
+    // word-at-a-time tag match can report as a false positive directly above a true match.
+    uint64_t same_tag = UINT64_MAX, near_tag = UINT64_MAX, absent = UINT64_MAX;
+    const uint64_t first = 1;
+    for ( uint64_t key = 2; same_tag == UINT64_MAX || near_tag == UINT64_MAX || absent == UINT64_MAX; key++ )
+    {
+        if ( test_group(key) != test_group(first) )  continue;
+
+        if      ( test_tag(key) == test_tag(first)           && same_tag == UINT64_MAX )  same_tag = key;
+        else if ( test_tag(key) == test_tag(first)           && absent   == UINT64_MAX )  absent   = key;
+        else if ( test_tag(key) == (test_tag(first) ^ 0x01)  && near_tag == UINT64_MAX )  near_tag = key;
+    }
+
+    // Few enough keys to stay in two groups, all in the same group so tags share a word.
+    FlatHashMap<uint64_t, uint64_t> map;
+    map[first]    = 10;
+    map[near_tag] = 20;
+    map[same_tag] = 30;
+    map[near_tag ^ (1ULL << 40)] = 40; // Any other keys, to fill the group.
+
+    REQUIRE( *map.find(first)    == 10 );
+    REQUIRE( *map.find(near_tag) == 20 );
+    REQUIRE( *map.find(same_tag) == 30 );
+    REQUIRE( map.find(absent)    == nullptr );
+
+    REQUIRE( map.erase(first) == 1 );
+    REQUIRE( map.find(first)     == nullptr );
+    REQUIRE( *map.find(near_tag) == 20 );
+    REQUIRE( *map.find(same_tag) == 30 );
+    REQUIRE( map.find(absent)    == nullptr );
+
+    map[absent] = 50;
+    REQUIRE( *map.find(absent)   == 50 );
+    REQUIRE( *map.find(same_tag) == 30 );
+    REQUIRE( map.size() == 4 );
+}
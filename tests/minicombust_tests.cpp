@@ -1,7 +1,7 @@
 #include "tests/particle_tests.hpp"
 #include "examples/mesh_examples.hpp"
 
-#define CATCH_CONFIG_MAIN
+#define CATCH_CONFIG_RUNNER
 #include "tests/catch.hpp"
 
 using namespace std;
@@ -13,7 +13,7 @@ bool check_particle_position(Mesh<double> *mesh, uint64_t correct_cell, vec<doub
 {
     if (PARTICLE_DEBUG)  cout << "Test: starting in " << print_vec (start) << " with velocity " << print_vec (velocity) << " -> cell " << correct_cell << endl;
     Particle_Logger logger;
-    Particle<double> *p = new Particle<double>(mesh, start, velocity, vec<double>{0, 0, 0}, 300., 0, &logger);
+    Particle<double> *p = new Particle<double>(mesh, start, velocity, vec<double>{0, 0, 0}, 300., 0, 0, &logger);
 
     if (PARTICLE_DEBUG)  cout << "Test: updating position, starting cell is " << p->cell << endl;
     memset(&logger, 0, sizeof(Particle_Logger));
@@ -30,7 +30,7 @@ bool check_particle_position(Mesh<double> *mesh, uint64_t correct_cell, vec<doub
     vec<double> zero_vector { 0.0, 0.0, 0.0 };
     double temp = 300.;
 
-    Particle<double> *p = new Particle<double>(mesh, x1, zero_vector, zero_vector, temp, starting_cell, &logger);
+    Particle<double> *p = new Particle<double>(mesh, x1, zero_vector, zero_vector, temp, starting_cell, 0, &logger);
 
     memset(&logger, 0, sizeof(Particle_Logger));
     p->update_cell(mesh, &logger);
@@ -41,11 +41,31 @@ bool check_particle_position(Mesh<double> *mesh, uint64_t correct_cell, vec<doub
 const vec<double> box_dim                  = { 100, 100, 100 };
 const vec<uint64_t> elements_per_dim       = { 10,  10,  10  };
  
-MPI_Config mpi_config = {0, 0, 1, 0, 0, 0, 0, 0, 0, 0};
-Mesh<double> *mesh    = load_mesh(&mpi_config, box_dim, elements_per_dim);
+MPI_Config mpi_config;
+
+// Meshes are built in MPI shared memory, so the tests run between MPI_Init and MPI_Finalize as a single particle rank.
+int main (int argc, char ** argv)
+{
+    MPI_Init(&argc, &argv);
+
+    mpi_config.world       = MPI_COMM_WORLD;
+    mpi_config.solver_type = PARTICLE;
+    MPI_Comm_rank(mpi_config.world, &mpi_config.rank);
+    MPI_Comm_size(mpi_config.world, &mpi_config.world_size);
+    mpi_config.particle_flow_world      = MPI_COMM_WORLD;
+    mpi_config.particle_flow_rank       = mpi_config.rank;
+    mpi_config.particle_flow_world_size = mpi_config.world_size;
+
+    const int result = Catch::Session().run(argc, argv);
+
+    MPI_Finalize();
+    return result;
+}
 
 TEST_CASE( "Particles can move from cell to cell correctly. (Cube Mesh)", "[particle]" ) {
 
+    Mesh<double> *mesh = load_mesh(&mpi_config, box_dim, elements_per_dim, 1);
+
     const vec<double> FRONT_UNIT_VEC = { 0.,  0., -1.};
     const vec<double> BACK_UNIT_VEC  = { 0.,  0.,  1.};
     const vec<double> LEFT_UNIT_VEC  = {-1.,  0.,  0.};
@@ -118,7 +138,7 @@ TEST_CASE( "Particles can move from cell to cell correctly. (Cube Mesh)", "[part
         const vec<double> start     = {.012004, .012004, .0122856};
     
         
-        Mesh<double> *mesh2         = load_mesh(&mpi_config, {0.3, 0.3, 0.3}, {50, 50, 50});
+        Mesh<double> *mesh2         = load_mesh(&mpi_config, {0.3, 0.3, 0.3}, {50, 50, 50}, 1);
 
         REQUIRE( check_particle_position(mesh2, 5102,   start, 5051));
     }
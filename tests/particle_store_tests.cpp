@@ -0,0 +1,107 @@
+#include "particles/ParticleStore.hpp"
+
+#include "tests/catch.hpp"
+
+using namespace std;
+
+using namespace minicombust::particles;
+
+
+// Every field of a particle is a different function of its id, so a misaligned column shows up as a wrong value.
+static Particle<double> make_particle(uint64_t id)
+{
+    const double d = (double)id;
+    Particle<double> particle({d, d + 0.1, d + 0.2}, {2 * d, 2 * d + 0.1, 2 * d + 0.2}, {3 * d, 3 * d + 0.1, 3 * d + 0.2},
+                              4 * d, 5 * d, 6 * d, (id * 37) % 101, id, 7 * d);
+    particle.age                  = 8 * d;
+    particle.local_flow_value     = { {9 * d, 9 * d + 0.1, 9 * d + 0.2}, 10 * d, 11 * d };
+    particle.particle_cell_fields = { {12 * d, 12 * d + 0.1, 12 * d + 0.2}, 13 * d, 14 * d };
+    return particle;
+}
+
+static void require_aligned(const ParticleStore<double>& store, uint64_t p)
+{
+    const uint64_t id = store.id[p];
+    const double   d  = (double)id;
+
+    REQUIRE( store.x1.get(p).x == d );        REQUIRE( store.x1.get(p).z == d + 0.2 );
+    REQUIRE( store.v1.get(p).x == 2 * d );    REQUIRE( store.v1.get(p).z == 2 * d + 0.2 );
+    REQUIRE( store.a1.get(p).x == 3 * d );    REQUIRE( store.a1.get(p).z == 3 * d + 0.2 );
+    REQUIRE( store.mass[p]     == 4 * d );
+    REQUIRE( store.temp[p]     == 5 * d );
+    REQUIRE( store.diameter[p] == 6 * d );
+    REQUIRE( store.weight[p]   == 7 * d );
+    REQUIRE( store.age[p]      == 8 * d );
+    REQUIRE( store.cell[p]     == (id * 37) % 101 );
+    REQUIRE( !store.decayed[p] );
+    REQUIRE( store.gas_vel.get(p).y  == 9 * d + 0.1 );
+    REQUIRE( store.gas_pressure[p]   == 10 * d );
+    REQUIRE( store.gas_temp[p]       == 11 * d );
+    REQUIRE( store.momentum.get(p).y == 12 * d + 0.1 );
+    REQUIRE( store.energy[p]         == 13 * d );
+    REQUIRE( store.fuel[p]           == 14 * d );
+}
+
+// Particles 0-9 survive, so compaction starts part way through, and the last particle decays.
+static inline bool decays(uint64_t id, uint64_t particles)
+{
+    return id >= 10 && (id % 3 == 0 || id % 7 == 2 || id == particles - 1);
+}
+
+TEST_CASE( "ParticleStore removes decayed particles in order and keeps columns aligned.", "[particle_store]" ) {
+
+    const uint64_t particles = 5000;
+
+    ParticleStore<double> store;
+    for ( uint64_t id = 0; id < particles; id++ )  store.append(make_particle(id));
+
+    vector<uint64_t> survivors;
+    for ( uint64_t id = 0; id < particles; id++ )
+    {
+        store.decayed[id] = decays(id, particles);
+        if ( !store.decayed[id] )  survivors.push_back(id);
+    }
+
+    store.remove_decayed();
+
+    REQUIRE( store.size() == survivors.size() );
+    for ( uint64_t p = 0; p < store.size(); p++ )
+    {
+        REQUIRE( store.id[p] == survivors[p] );
+        require_aligned(store, p);
+    }
+
+    // Nothing left to remove.
+    store.remove_decayed();
+    REQUIRE( store.size() == survivors.size() );
+
+    SECTION( "Sorting the compacted store by cell keeps columns aligned and ties in id order." ) {
+        store.sort_by_cell();
+
+        REQUIRE( store.size() == survivors.size() );
+        for ( uint64_t p = 0; p < store.size(); p++ )
+        {
+            require_aligned(store, p);
+            if ( p > 0 )
+            {
+                REQUIRE( store.cell[p - 1] <= store.cell[p] );
+                if ( store.cell[p - 1] == store.cell[p] )  REQUIRE( store.id[p - 1] < store.id[p] );
+            }
+        }
+
+        // Decaying and removing after the sort keeps the sorted order.
+        for ( uint64_t p = 0; p < store.size(); p++ )  store.decayed[p] = store.id[p] % 2;
+        vector<uint64_t> sorted_survivors;
+        for ( uint64_t p = 0; p < store.size(); p++ )
+            if ( !store.decayed[p] )  sorted_survivors.push_back(store.id[p]);
+
+        store.remove_decayed();
+
+        REQUIRE( store.size() == sorted_survivors.size() );
+        for ( uint64_t p = 0; p < store.size(); p++ )
+        {
+            REQUIRE( store.id[p] == sorted_survivors[p] );
+            require_aligned(store, p);
+        }
+    }
+}
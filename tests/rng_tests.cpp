@@ -0,0 +1,75 @@
+#include "particles/ParticleDistribution.hpp"
+#include "utils/CounterRNG.hpp"
+
+#include "tests/catch.hpp"
+
+using namespace std;
+
+using namespace minicombust::particles;
+using namespace minicombust::utils;
+
+
+// Philox4x32-10 known answer vectors from Random123 (kat_vectors): counter, key, then the expected output.
+struct philox_kat
+{
+    uint32_t ctr[4];
+    uint32_t key[2];
+    uint32_t expected[4];
+};
+
+static const philox_kat philox_kats[] =
+{
+    { {0x00000000, 0x00000000, 0x00000000, 0x00000000}, {0x00000000, 0x00000000}, {0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8} },
+    { {0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff}, {0xffffffff, 0xffffffff}, {0x408f276d, 0x41c83b0e, 0xa20bc7c6, 0x6d5451fd} },
+    { {0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344}, {0xa4093822, 0x299f31d0}, {0xd16cfe09, 0x94fdcceb, 0x5001e420, 0x24126ea1} },
+};
+
+TEST_CASE( "Philox4x32-10 matches the Random123 known answers.", "[rng]" ) {
+
+    for ( const philox_kat& kat : philox_kats )
+    {
+        uint32_t ctr[4] = { kat.ctr[0], kat.ctr[1], kat.ctr[2], kat.ctr[3] };
+        philox4x32_10(ctr, kat.key[0], kat.key[1]);
+
+        for ( int i = 0; i < 4; i++ )
+            REQUIRE( ctr[i] == kat.expected[i] );
+    }
+}
+
+TEST_CASE( "Emitted particles draw the same numbers whatever the number of particle ranks.", "[rng]" ) {
+
+    const uint64_t seed      = 42;
+    const uint64_t particles = 103; // Per timestep, over all ranks
+
+    for ( uint64_t timestep = 1; timestep <= 4; timestep++ )
+    {
+        // Draws of each particle of the timestep, emitted from a single rank.
+        vector<double> serial_draws;
+        uint64_t serial_first_id, serial_count;
+        ParticleDistribution<double>::emitted_ids(timestep, particles, 0, 0, 1, serial_first_id, serial_count);
+        REQUIRE( serial_count == particles );
+        for ( uint64_t id = serial_first_id; id < serial_first_id + serial_count; id++ )
+            serial_draws.push_back(counter_uniform(seed, STREAM_EMIT, id, timestep, 0));
+
+        for ( int ranks = 2; ranks <= 7; ranks++ )
+        {
+            vector<double> draws;
+            uint64_t next_id = serial_first_id;
+            for ( int rank = 0; rank < ranks; rank++ )
+            {
+                uint64_t first_id, count;
+                ParticleDistribution<double>::emitted_ids(timestep, particles / ranks, particles % ranks, rank, ranks, first_id, count);
+
+                // Ranks emit consecutive runs of ids, in rank order.
+                REQUIRE( first_id == next_id );
+                next_id += count;
+
+                for ( uint64_t id = first_id; id < first_id + count; id++ )
+                    draws.push_back(counter_uniform(seed, STREAM_EMIT, id, timestep, 0));
+            }
+
+            REQUIRE( next_id == serial_first_id + particles );
+            REQUIRE( draws == serial_draws );
+        }
+    }
+}